@@ -2,4 +2,6 @@ file(READ "${SOURCE}" FILE_CONTENTS)
 string(CONCAT FILE_CONTENTS "${FILE_CONTENTS}" "\n    cdef struct b2TreeNode\n")
 string(REPLACE "bool " "bint " FILE_CONTENTS "${FILE_CONTENTS}")
 string(REPLACE "bool*" "bint*" FILE_CONTENTS "${FILE_CONTENTS}")
+# allow env functions to be called without holding the GIL
+string(REGEX REPLACE "cdef extern from \"([^\"]*)\":" "cdef extern from \"\\1\" nogil:" FILE_CONTENTS "${FILE_CONTENTS}")
 file(WRITE "${TARGET}" "${FILE_CONTENTS}")
@@ -1,6 +1,9 @@
-from libc.stdint cimport int8_t, int32_t, uint8_t, uint16_t, uint64_t
+from libc.stdint cimport int8_t, int32_t, uint8_t, uint16_t, uint32_t, uint64_t
 from libc.stdlib cimport calloc, free
 
+import os
+import warnings
+
 import pufferlib
 
 from impulse_wars cimport (
@@ -9,6 +12,13 @@ from impulse_wars cimport (
     discreteObsSize,
     continuousObsSize,
     obsBytes,
+    formattedObsBytes,
+    obsFormatValueBytes,
+    obsFormat,
+    OBS_FORMAT_FLOAT32,
+    OBS_FORMAT_FLOAT16,
+    OBS_FORMAT_INT8,
+    INT8_OBS_SCALE,
     alignedSize,
     MAP_OBS_SIZE,
     NUM_WALL_TYPES,
@@ -45,7 +55,11 @@ from impulse_wars cimport (
     NUM_MAPS,
     initEnv,
     initMaps,
+    loadMapPaths,
     setupEnv,
+    initObsDoubleBuffer,
+    setObsFormat,
+    publishObs,
     rayClient,
     createRayClient,
     destroyRayClient,
@@ -53,15 +67,54 @@ from impulse_wars cimport (
     stepEnv,
     destroyMaps,
     destroyEnv,
-    LOG_BUFFER_SIZE,
     logBuffer,
-    logEntry,
-    createLogBuffer,
-    destroyLogBuffer,
-    aggregateAndClearLogBuffer,
+    logSummary,
 )
 
 
+# the thread pool header isn't parsed by autopxd since it pulls in
+# pthreads, so declare what we need from it here
+cdef extern from "thread_pool.h" nogil:
+    ctypedef struct threadPool:
+        pass
+
+    ctypedef struct poolStats:
+        float batches
+        float batchTime
+        float imbalance
+        float maxImbalance
+        float tailTime
+        float idleFraction
+        float steals
+
+    threadPool *createThreadPool(env *envs, uint16_t numEnvs, uint16_t numThreads)
+    void destroyThreadPool(threadPool *pool)
+    logBuffer *threadPoolEnvLogs(const threadPool *pool, const uint16_t envIdx)
+    void stepEnvs(threadPool *pool)
+    void resetEnvs(threadPool *pool)
+    void stepEnvsAsync(threadPool *pool, const uint16_t envStart, const uint16_t envEnd)
+    void waitForEnvs(threadPool *pool)
+    logSummary aggregateAndClearThreadPoolLogs(threadPool *pool, const uint8_t numDrones)
+    poolStats aggregateAndClearPoolStats(threadPool *pool)
+
+
+cdef extern from "env_state.h" nogil:
+    ctypedef struct envState:
+        uint8_t *data
+        uint32_t size
+        uint32_t capacity
+
+    cdef enum envStateStatus:
+        ENV_STATE_OK
+
+    envState *createEnvState()
+    void destroyEnvState(envState *s)
+    void saveEnvState(const env *e, envState *s)
+    const char *envStateStatusMessage(const envStateStatus status)
+    envStateStatus restoreEnvState(env *e, const envState *s)
+    void cloneEnv(env *dst, const env *src, envState *scratch)
+
+
 # doesn't seem like you can directly import C or Cython constants 
 # from Python so we have to create wrapper functions
 
@@ -73,14 +126,32 @@ def continuousActionsSize() -> int:
     return CONTINUOUS_ACTION_SIZE
 
 
-def obsConstants(numDrones: int) -> pufferlib.Namespace:
+OBS_FORMATS = {
+    "float32": OBS_FORMAT_FLOAT32,
+    "float16": OBS_FORMAT_FLOAT16,
+    "int8": OBS_FORMAT_INT8,
+}
+
+
+def _obsFormat(name: str) -> int:
+    if name not in OBS_FORMATS:
+        raise ValueError(f"unknown obs format {name}, must be one of {list(OBS_FORMATS)}")
+    return OBS_FORMATS[name]
+
+
+# continuous observations are stored in formatName, they should be
+# multiplied by continuousObsScale after being converted to floats
+def obsConstants(numDrones: int, formatName: str = "float32") -> pufferlib.Namespace:
+    cdef obsFormat format = _obsFormat(formatName)
     droneObsOffset = ENEMY_DRONE_OBS_OFFSET + ((numDrones - 1) * ENEMY_DRONE_OBS_SIZE)
     return pufferlib.Namespace(
-        obsBytes=obsBytes(numDrones),
+        obsBytes=formattedObsBytes(numDrones, format),
         mapObsSize=MAP_OBS_SIZE,
         discreteObsSize=discreteObsSize(numDrones),
         continuousObsSize=continuousObsSize(numDrones),
-        continuousObsBytes=continuousObsSize(numDrones) * sizeof(float),
+        continuousObsBytes=continuousObsSize(numDrones) * obsFormatValueBytes(format),
+        continuousObsDtype=formatName,
+        continuousObsScale=1.0 / INT8_OBS_SCALE if format == OBS_FORMAT_INT8 else 1.0,
         wallTypes=NUM_WALL_TYPES,
         weaponTypes=NUM_WEAPONS + 1,
         mapObsRows=MAP_OBS_ROWS,
@@ -123,15 +194,22 @@ cdef class CyImpulseWars:
         uint8_t numDrones
         bint render
         env* envs
-        logBuffer *logs
+        threadPool *pool
+        envState *state
         rayClient* rayClient
 
-    def __init__(self, uint16_t numEnvs, uint8_t numDrones, uint8_t numAgents, uint8_t[:, :] observations, bint discretizeActions, float[:, :] contActions, int32_t[:, :] discActions, float[:] rewards, uint8_t[:] masks, uint8_t[:] terminals, uint8_t[:] truncations, uint64_t seed, bint render, bint enableTeams, bint sittingDuck, bint isTraining, bint humanControl):
+    def __init__(self, uint16_t numEnvs, uint8_t numDrones, uint8_t numAgents, uint8_t[:, :] observations, uint8_t[:, :] backObservations, str obsFormatName, bint discretizeActions, float[:, :] contActions, int32_t[:, :] discActions, float[:] rewards, uint8_t[:] masks, uint8_t[:] terminals, uint8_t[:] truncations, uint64_t seed, bint render, bint enableTeams, bint sittingDuck, bint isTraining, bint humanControl, uint16_t numThreads):
         self.numEnvs = numEnvs
         self.numDrones = numDrones
         self.render = render
         self.envs = <env*>calloc(numEnvs, sizeof(env))
-        self.logs = createLogBuffer(LOG_BUFFER_SIZE)
+        cdef obsFormat format = _obsFormat(obsFormatName)
+
+        # raylib isn't thread safe, so render from the calling thread only
+        if render:
+            numThreads = 1
+        self.pool = createThreadPool(self.envs, numEnvs, numThreads)
+        self.state = createEnvState()
 
         cdef int inc = numAgents
         cdef int i
@@ -152,7 +230,7 @@ cdef class CyImpulseWars:
                 &masks[i * inc],
                 &terminals[i * inc],
                 &truncations[i * inc],
-                self.logs,
+                threadPoolEnvLogs(self.pool, i),
                 mapIdx,
                 seed + i,
                 enableTeams,
@@ -160,10 +238,20 @@ cdef class CyImpulseWars:
                 isTraining,
             )
             self.envs[i].humanInput = humanControl
+            setObsFormat(&self.envs[i], format)
+            if backObservations is not None:
+                initObsDoubleBuffer(&self.envs[i], &backObservations[i * inc, 0])
+
+        # paths are precomputed at build time and shared between processes
+        # with mmap, initMaps will compute them if the file can't be used
+        mapPathsFile = os.path.join(os.path.dirname(os.path.abspath(__file__)), "map_paths.bin")
+        if not loadMapPaths(mapPathsFile.encode()):
+            warnings.warn(f"failed to load precomputed map paths from {mapPathsFile}, computing them instead")
 
         initMaps(&self.envs[i])
         for i in range(self.numEnvs):
             setupEnv(&self.envs[i])
+            publishObs(&self.envs[i])
 
     cdef _initRaylib(self):
         self.rayClient = createRayClient()
@@ -175,25 +263,79 @@ cdef class CyImpulseWars:
         if self.render and self.rayClient == NULL:
             self._initRaylib()
 
-        cdef int i
-        for i in range(self.numEnvs):
-            resetEnv(&self.envs[i])
+        with nogil:
+            resetEnvs(self.pool)
 
     def step(self):
-        cdef int i
-        for i in range(self.numEnvs):
-            stepEnv(&self.envs[i])
+        with nogil:
+            stepEnvs(self.pool)
+
+    def stepAsync(self, uint16_t envStart, uint16_t envEnd):
+        if envStart >= envEnd or envEnd > self.numEnvs:
+            raise IndexError(f"invalid env range [{envStart}, {envEnd}) for {self.numEnvs} envs")
+        with nogil:
+            stepEnvsAsync(self.pool, envStart, envEnd)
+
+    def stepWait(self):
+        with nogil:
+            waitForEnvs(self.pool)
+
+    def publishedObsBuffer(self, uint16_t envIdx) -> int:
+        self._checkEnvIdx(envIdx)
+        return self.envs[envIdx].publishedObsIdx
 
     def log(self):
-        cdef logEntry log = aggregateAndClearLogBuffer(self.numDrones, self.logs)
-        return log
+        cdef logSummary summary = aggregateAndClearThreadPoolLogs(self.pool, self.numDrones)
+        return summary
+
+    def _checkEnvIdx(self, uint16_t envIdx):
+        if envIdx >= self.numEnvs:
+            raise IndexError(f"env index {envIdx} out of range for {self.numEnvs} envs")
+
+    def saveState(self, uint16_t envIdx) -> bytes:
+        self._checkEnvIdx(envIdx)
+        with nogil:
+            waitForEnvs(self.pool)
+            saveEnvState(&self.envs[envIdx], self.state)
+        return (<char *>self.state.data)[:self.state.size]
+
+    def restoreState(self, uint16_t envIdx, const uint8_t[:] state):
+        self._checkEnvIdx(envIdx)
+        if state.shape[0] == 0:
+            raise ValueError("empty env state")
+        # restore directly from the caller's buffer, it's only read
+        cdef envState s
+        s.data = <uint8_t *>&state[0]
+        s.size = state.shape[0]
+        s.capacity = state.shape[0]
+        cdef envStateStatus status
+        with nogil:
+            waitForEnvs(self.pool)
+            status = restoreEnvState(&self.envs[envIdx], &s)
+        if status != ENV_STATE_OK:
+            raise ValueError(envStateStatusMessage(status).decode())
+
+    def cloneEnv(self, uint16_t dstIdx, uint16_t srcIdx):
+        self._checkEnvIdx(dstIdx)
+        self._checkEnvIdx(srcIdx)
+        if dstIdx == srcIdx:
+            return
+        with nogil:
+            waitForEnvs(self.pool)
+            cloneEnv(&self.envs[dstIdx], &self.envs[srcIdx], self.state)
+
+    def threadStats(self):
+        cdef poolStats stats = aggregateAndClearPoolStats(self.pool)
+        return stats
 
     def close(self):
+        destroyThreadPool(self.pool)
+
         cdef int i
         for i in range(self.numEnvs):
             destroyEnv(&self.envs[i])
 
-        destroyLogBuffer(self.logs)
+        destroyEnvState(self.state)
         destroyMaps()
         free(self.envs)
 
@@ -14,15 +14,71 @@ from cy_impulse_wars import (
 )
 
 
+def transformDistribution(prefix: str, rawDist: Dict[str, float]):
+    return {
+        f"{prefix}_min": rawDist["min"],
+        f"{prefix}_max": rawDist["max"],
+        f"{prefix}_p10": rawDist["p10"],
+        f"{prefix}_p50": rawDist["p50"],
+        f"{prefix}_p90": rawDist["p90"],
+        f"{prefix}_p99": rawDist["p99"],
+    }
+
+
 def transformRawLog(numDrones: int, rawLog: Dict[str, float]):
+    mean = rawLog["mean"]
+    stddev = rawLog["stddev"]
     log = {
-        "length": rawLog["length"],
-        "ties": rawLog["ties"],
+        "episodes": rawLog["episodes"],
+        "length": mean["length"],
+        "length_std": stddev["length"],
+        "ties": mean["ties"],
+        "heap_allocs": mean["heapAllocs"],
     }
+    log.update(transformDistribution("length", rawLog["length"]))
+
+    # step timings are only measured if the module was built with
+    # STEP_TIMERS defined, otherwise they're all 0
+    stepTimes = mean["stepTimes"]
+    if any(stepTimes.values()):
+        log["step_time_actions_us"] = stepTimes["actions"]
+        log["step_time_physics_us"] = stepTimes["physics"]
+        log["step_time_body_move_events_us"] = stepTimes["bodyMoveEvents"]
+        log["step_time_contact_events_us"] = stepTimes["contactEvents"]
+        log["step_time_sensor_events_us"] = stepTimes["sensorEvents"]
+        log["step_time_projectiles_us"] = stepTimes["projectiles"]
+        log["step_time_drones_us"] = stepTimes["drones"]
+        log["step_time_pickups_us"] = stepTimes["pickups"]
+        log["step_time_rewards_us"] = stepTimes["rewards"]
+        log["step_time_obs_us"] = stepTimes["obs"]
+        log["step_time_reset_us"] = stepTimes["reset"]
+
+    # box2d stats are only recorded if the module was built with
+    # PHYSICS_STATS defined
+    physics = mean["physics"]
+    if any(physics.values()):
+        log["physics_step_ms"] = physics["step"]
+        log["physics_pairs_ms"] = physics["pairs"]
+        log["physics_refit_ms"] = physics["refit"]
+        log["physics_collide_ms"] = physics["collide"]
+        log["physics_solve_ms"] = physics["solve"]
+        log["physics_solve_constraints_ms"] = physics["solveConstraints"]
+        log["physics_continuous_ms"] = physics["continuous"]
+        log["physics_split_islands_ms"] = physics["splitIslands"]
+        log["physics_sleep_islands_ms"] = physics["sleepIslands"]
+        log["physics_bodies"] = physics["bodies"]
+        log["physics_shapes"] = physics["shapes"]
+        log["physics_contacts"] = physics["contacts"]
+        log["physics_joints"] = physics["joints"]
+        log["physics_islands"] = physics["islands"]
+        log["physics_tree_height"] = physics["treeHeight"]
+        log["physics_static_tree_height"] = physics["staticTreeHeight"]
 
     count = 0
-    for i, stats in enumerate(rawLog["stats"]):
+    for i, stats in enumerate(mean["stats"]):
         log[f"drone_{i}_reward"] = stats["reward"]
+        log[f"drone_{i}_reward_std"] = stddev["stats"][i]["reward"]
+        log.update(transformDistribution(f"drone_{i}_reward", rawLog["reward"][i]))
         log[f"drone_{i}_wins"] = stats["wins"]
         log[f"drone_{i}_distance_traveled"] = stats["distanceTraveled"]
         log[f"drone_{i}_abs_distance_traveled"] = stats["absDistanceTraveled"]
@@ -44,6 +100,17 @@ def transformRawLog(numDrones: int, rawLog: Dict[str, float]):
     return log
 
 
+def transformThreadStats(rawStats: Dict[str, float]):
+    return {
+        "thread_batch_time_us": rawStats["batchTime"],
+        "thread_imbalance": rawStats["imbalance"],
+        "thread_max_imbalance": rawStats["maxImbalance"],
+        "thread_tail_time_us": rawStats["tailTime"],
+        "thread_idle_fraction": rawStats["idleFraction"],
+        "thread_steals": rawStats["steals"],
+    }
+
+
 class ImpulseWars(pufferlib.PufferEnv):
     def __init__(
         self,
@@ -53,11 +120,15 @@ class ImpulseWars(pufferlib.PufferEnv):
         enable_teams: bool = False,
         sitting_duck: bool = False,
         discretize_actions: bool = False,
+        obs_format: str = "float32",
         is_training: bool = True,
         human_control: bool = False,
         seed: int = 0,
         render: bool = False,
         report_interval: int = 64,
+        num_threads: int = 1,
+        double_buffered: bool = False,
+        double_buffered_obs: bool = False,
         buf=None,
     ):
         if num_drones > maxDrones() or num_drones <= 0:
@@ -66,10 +137,19 @@ class ImpulseWars(pufferlib.PufferEnv):
             raise ValueError("num_agents must greater than 0 and less than or equal to num_drones")
         if enable_teams and (num_drones % 2 != 0 or num_drones <= 2):
             raise ValueError("enable_teams is only supported for even numbers of drones greater than 2")
-
+        if num_threads <= 0:
+            raise ValueError("num_threads must be greater than 0")
+        if double_buffered and num_envs < 2:
+            raise ValueError("double_buffered requires at least 2 envs")
+        if double_buffered_obs and buf is not None:
+            raise ValueError("double_buffered_obs can't be used with shared buffers")
+
+        self.numEnvs = num_envs
         self.numDrones = num_drones
         self.num_agents = num_agents * num_envs
-        self.obsInfo = obsConstants(self.numDrones)
+        # continuous observations can be stored as float16 or int8 to
+        # save memory and bandwidth
+        self.obsInfo = obsConstants(self.numDrones, obs_format)
         self.tick = 0
 
         # map observations are bit packed to save space, and scalar
@@ -99,6 +179,7 @@ class ImpulseWars(pufferlib.PufferEnv):
             )
 
         self.report_interval = report_interval
+        self.num_threads = num_threads
         self.render_mode = "human" if render else None
 
         super().__init__(buf)
@@ -112,11 +193,22 @@ class ImpulseWars(pufferlib.PufferEnv):
         else:
             discreteActions = np.zeros((self.num_agents, *self.single_action_space.shape), dtype=np.int32)
 
+        # if observations are double buffered the envs compute the next
+        # observations into one buffer while the last published ones can
+        # still be read from the other
+        backObservations = None
+        self.obsBuffers = [self.observations]
+        if double_buffered_obs:
+            backObservations = np.zeros_like(self.observations)
+            self.obsBuffers.append(backObservations)
+
         self.c_envs = CyImpulseWars(
             num_envs,
             num_drones,
             num_agents,
             self.observations,
+            backObservations,
+            obs_format,
             discretize_actions,
             continuousActions,
             discreteActions,
@@ -130,25 +222,130 @@ class ImpulseWars(pufferlib.PufferEnv):
             sitting_duck,
             is_training,
             human_control,
+            num_threads,
         )
 
+        # send/recv split the envs into halves if double buffered, one
+        # half is stepped by the C worker threads while the policy runs on
+        # the observations of the other half
+        numBuffers = 2 if double_buffered else 1
+        self.bufferEnvs = []
+        self.bufferAgents = []
+        for i in range(numBuffers):
+            envStart = i * num_envs // numBuffers
+            envEnd = (i + 1) * num_envs // numBuffers
+            self.bufferEnvs.append((envStart, envEnd))
+            self.bufferAgents.append(slice(envStart * num_agents, envEnd * num_agents))
+        self.agentIDs = np.arange(self.num_agents)
+        self.recvBuffer = 0
+        self.steppingBuffer = None
+        self.infos = []
+
+        self._updateObservations()
+
     def reset(self, seed=None):
         self.c_envs.reset()
+        self._updateObservations()
         self.tick = 0
+        self.recvBuffer = 0
+        self.steppingBuffer = None
+        self.infos = []
         return self.observations, []
 
     def step(self, actions):
         self.actions[:] = actions
         self.c_envs.step()
+        self._updateObservations()
+        return self.observations, self.rewards, self.terminals, self.truncations, self._tickInfos()
+
+    def step_async(self, actions):
+        self.actions[:] = actions
+        self.c_envs.stepAsync(0, self.numEnvs)
+
+    def step_wait(self):
+        self.c_envs.stepWait()
+        self._updateObservations()
+        return self.observations, self.rewards, self.terminals, self.truncations, self._tickInfos()
+
+    # pufferlib's vectorization interface, used by clean_pufferl.py when
+    # the native backend is used; recv returns the observations of one
+    # buffer of envs and send steps that buffer in the background
+    def async_reset(self, seed=None):
+        self.reset(seed)
+
+    def send(self, actions):
+        buf = self.recvBuffer
+        self.actions[self.bufferAgents[buf]] = actions
+        envStart, envEnd = self.bufferEnvs[buf]
+        # if the other buffer is still being stepped it will be finished
+        # first, only one buffer is in flight at a time
+        self.c_envs.stepAsync(envStart, envEnd)
+        self.steppingBuffer = buf
+
+        self.recvBuffer = (buf + 1) % len(self.bufferEnvs)
+        if self.recvBuffer == 0:
+            self.infos.extend(self._tickInfos())
+
+    def recv(self):
+        buf = self.recvBuffer
+        if self.steppingBuffer == buf:
+            self.c_envs.stepWait()
+            self.steppingBuffer = None
+
+        infos = self.infos
+        self.infos = []
+        envStart, _ = self.bufferEnvs[buf]
+        agents = self.bufferAgents[buf]
+        return (
+            self.obsBuffers[self.c_envs.publishedObsBuffer(envStart)][agents],
+            self.rewards[agents],
+            self.terminals[agents],
+            self.truncations[agents],
+            infos,
+            self.agentIDs[agents],
+            self.masks[agents],
+        )
 
+    # points observations at the buffer holding the last published
+    # observations; envs a step or reset skips publish their last
+    # observations again, so every env always publishes to the same
+    # buffer; no envs can be in flight when this is called
+    def _updateObservations(self):
+        if len(self.obsBuffers) == 1:
+            return
+
+        published = self.c_envs.publishedObsBuffer(0)
+        for envStart, _ in self.bufferEnvs[1:]:
+            assert self.c_envs.publishedObsBuffer(envStart) == published
+        self.observations = self.obsBuffers[published]
+
+    # counts a step of every env, and aggregates logs every report_interval steps
+    def _tickInfos(self):
         infos = []
         self.tick += 1
         if self.tick % self.report_interval == 0:
             rawLog = self.c_envs.log()
-            if rawLog["length"] > 0:
-                infos.append(transformRawLog(self.numDrones, rawLog))
-
-        return self.observations, self.rewards, self.terminals, self.truncations, infos
+            log = {}
+            if rawLog["episodes"] > 0:
+                log = transformRawLog(self.numDrones, rawLog)
+            if self.num_threads > 1:
+                log.update(transformThreadStats(self.c_envs.threadStats()))
+            if log:
+                infos.append(log)
+
+        return infos
+
+    def save_state(self, env_idx: int) -> bytes:
+        return self.c_envs.saveState(env_idx)
+
+    def restore_state(self, env_idx: int, state: bytes):
+        # observations, rewards, terminals and truncations of the env are
+        # restored as well; raises ValueError and leaves the env unchanged
+        # if the state is invalid
+        self.c_envs.restoreState(env_idx, state)
+
+    def clone_env(self, dst_idx: int, src_idx: int):
+        self.c_envs.cloneEnv(dst_idx, src_idx)
 
     def render(self):
         pass
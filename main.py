@@ -29,6 +29,7 @@ def make_policy(env, config, isTraining: bool):
         config.train.minibatch_size,
         config.env.num_drones,
         config.env.discretize_actions,
+        config.env.obs_format,
         isTraining,
         config.train.device,
     )
@@ -59,9 +60,13 @@ def train(args) -> Deque[Dict[str, Any]] | None:
             enable_teams=args.env.enable_teams,
             sitting_duck=args.env.sitting_duck,
             discretize_actions=args.env.discretize_actions,
+            obs_format=args.env.obs_format,
             is_training=True,
             seed=args.seed,
             render=args.render,
+            num_threads=args.env.num_threads,
+            double_buffered=args.env.double_buffered,
+            double_buffered_obs=args.env.double_buffered_obs,
         ),
         num_workers=args.vec.num_workers,
         batch_size=args.vec.env_batch_size,
@@ -206,6 +211,13 @@ if __name__ == "__main__":
     parser.add_argument("--train.target-kl", type=float, default=0.2)
 
     parser.add_argument("--env.discretize-actions", action="store_false")
+    parser.add_argument(
+        "--env.obs-format",
+        type=str,
+        default="float32",
+        choices=["float32", "float16", "int8"],
+        help="How continuous observations are stored, float16 and int8 use less memory and bandwidth",
+    )
     parser.add_argument("--env.num-drones", type=int, default=2, help="Number of drones in the environment")
     parser.add_argument(
         "--env.num-agents",
@@ -216,6 +228,19 @@ if __name__ == "__main__":
     parser.add_argument("--env.enable-teams", action="store_true", help="Split drones into 2 teams")
     parser.add_argument("--env.human-control", action="store_true", help="Enable human control by default")
     parser.add_argument("--env.sitting-duck", action="store_true", help="Scripted drones will do nothing")
+    parser.add_argument(
+        "--env.num-threads", type=int, default=1, help="Number of threads used to step internal envs in each process"
+    )
+    parser.add_argument(
+        "--env.double-buffered",
+        action="store_true",
+        help="Step half of the internal envs while the policy runs on the other half, only used with the native backend",
+    )
+    parser.add_argument(
+        "--env.double-buffered-obs",
+        action="store_true",
+        help="Compute observations into a back buffer so the last observations stay readable during a step, only used with the native backend",
+    )
 
     parser.add_argument("--vec.backend", type=str, default="multiprocessing")
     parser.add_argument("--vec.num-envs", type=int, default=8)
@@ -269,6 +294,7 @@ if __name__ == "__main__":
                 enable_teams=args.env.enable_teams,
                 sitting_duck=args.env.sitting_duck,
                 discretize_actions=args.env.discretize_actions,
+                obs_format=args.env.obs_format,
                 is_training=False,
                 human_control=args.env.human_control,
                 render=True,
@@ -32,6 +32,7 @@ class Policy(nn.Module):
         batchSize: int,
         numDrones: int,
         discretizeActions: bool = False,
+        obsFormat: str = "float32",
         isTraining: bool = True,
         device: str = "cuda",
     ):
@@ -41,7 +42,7 @@ class Policy(nn.Module):
 
         self.numDrones = numDrones
         self.isTraining = isTraining
-        self.obsInfo = obsConstants(numDrones)
+        self.obsInfo = obsConstants(numDrones, obsFormat)
 
         self.discreteFactors = np.array(
             [self.obsInfo.wallTypes] * self.obsInfo.numNearWallObs
@@ -58,11 +59,11 @@ class Policy(nn.Module):
         self.register_buffer("multihotOutput", multihotBuffer, persistent=False)
 
         # most of the observation is a 2D array of bytes, but the end
-        # contains around 200 floats; this allows us to treat the end
-        # of the observation as a float array
+        # contains around 200 floats, possibly quantized; this allows us
+        # to treat the end of the observation as an array of them
         _, *self.dtype = _nativize_dtype(
             np.dtype((np.uint8, (self.obsInfo.continuousObsBytes,))),
-            np.dtype((np.float32, (self.obsInfo.continuousObsSize,))),
+            np.dtype((np.dtype(self.obsInfo.continuousObsDtype), (self.obsInfo.continuousObsSize,))),
         )
         self.dtype = tuple(self.dtype)
 
@@ -182,7 +183,9 @@ class Policy(nn.Module):
         weaponTypes = th.flatten(weaponTypes, start_dim=1, end_dim=-1)
 
         # process continuous observations
-        continuousObs = nativize_tensor(obs[:, self.obsInfo.continuousObsOffset :], self.dtype)
+        continuousObs = nativize_tensor(obs[:, self.obsInfo.continuousObsOffset :], self.dtype).float()
+        if self.obsInfo.continuousObsScale != 1.0:
+            continuousObs = continuousObs * self.obsInfo.continuousObsScale
 
         # combine all observations and feed through final linear encoder
         features = th.cat((map, multihotOutput, weaponTypes, continuousObs), dim=-1)
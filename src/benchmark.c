@@ -1,68 +1,314 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
 #include "env.h"
+#include "tool_env.h"
 
-void randActions(env *e) {
-    // e->lastRandState = e->randState;
-    uint8_t actionOffset = 0;
-    for (uint8_t i = 0; i < e->numDrones; i++) {
-        e->contActions[actionOffset + 0] = randFloat(&e->randState, -1.0f, 1.0f);
-        e->contActions[actionOffset + 1] = randFloat(&e->randState, -1.0f, 1.0f);
-        e->contActions[actionOffset + 2] = randFloat(&e->randState, -1.0f, 1.0f);
-        e->contActions[actionOffset + 3] = randFloat(&e->randState, -1.0f, 1.0f);
-        e->contActions[actionOffset + 4] = randFloat(&e->randState, -1.0f, 1.0f);
-        e->contActions[actionOffset + 5] = randFloat(&e->randState, -1.0f, 1.0f);
-        e->contActions[actionOffset + 6] = randFloat(&e->randState, -1.0f, 1.0f);
-
-        actionOffset += CONTINUOUS_ACTION_SIZE;
-    }
-}
+#define DEFAULT_SCENARIO_STEPS 100000
+#define BENCHMARK_SEED 1337
+#define MAX_SCENARIOS 64
 
-void perfTest(const uint32_t numSteps) {
-    const uint8_t NUM_DRONES = 2;
+// a benchmark configuration, runs a single env for a fixed number of
+// steps; agents take random actions and the remaining drones are scripted
+typedef struct scenario {
+    char name[64];
+    int8_t mapIdx;
+    uint8_t numDrones;
+    uint8_t numAgents;
+    bool enableTeams;
+    int8_t defaultWeapon;
+    bool isTraining;
+} scenario;
 
-    env *e = fastCalloc(1, sizeof(env));
+typedef struct scenarioResult {
+    uint32_t steps;
+    double seconds;
+    double stepsPerSec;
+    double p50StepUs;
+    double p99StepUs;
+    uint32_t resets;
+    double resetsPerSec;
+    long peakRSSKb;
+} scenarioResult;
 
-    uint8_t *obs = NULL;
-    posix_memalign((void **)&obs, sizeof(void *), alignedSize(NUM_DRONES * obsBytes(NUM_DRONES), sizeof(float)));
+// the peak RSS of the process; scenarios each run in their own process,
+// so this includes the maps set up before forking but nothing from other
+// scenarios
+long peakRSSKb() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+    // ru_maxrss is in kilobytes on Linux
+    return usage.ru_maxrss;
+}
 
-    float *rewards = fastCalloc(NUM_DRONES, sizeof(float));
-    float *actions = fastCalloc(NUM_DRONES * CONTINUOUS_ACTION_SIZE, sizeof(float));
-    uint8_t *masks = fastCalloc(NUM_DRONES, sizeof(uint8_t));
-    uint8_t *terminals = fastCalloc(NUM_DRONES, sizeof(uint8_t));
-    uint8_t *truncations = fastCalloc(NUM_DRONES, sizeof(uint8_t));
-    logBuffer *logs = createLogBuffer(1);
+int compareLatencies(const void *a, const void *b) {
+    const uint32_t latencyA = *(const uint32_t *)a;
+    const uint32_t latencyB = *(const uint32_t *)b;
+    return (latencyA > latencyB) - (latencyA < latencyB);
+}
 
-    // rayClient *client = createRayClient();
-    // e->client = client;
+// latencies must be sorted
+double percentileUs(const uint32_t *latencies, const uint32_t numLatencies, const double percentile) {
+    const uint32_t idx = min((uint32_t)(percentile * numLatencies), numLatencies - 1);
+    return latencies[idx] / 1000.0;
+}
 
-    time_t seed = time(NULL);
-    initEnv(e, NUM_DRONES, NUM_DRONES, obs, false, actions, NULL, rewards, masks, terminals, truncations, logs, -1, seed, false, false, true);
-    initMaps(e);
+scenarioResult runScenario(const scenario *s, const uint32_t numSteps, const uint64_t seed) {
+    toolEnv t = createToolEnv(s->numDrones, s->numAgents, s->mapIdx, seed, s->enableTeams, s->isTraining);
+    env *e = t.e;
+    e->pinnedDefaultWeapon = s->defaultWeapon;
+    uint32_t *latencies = fastMalloc(numSteps * sizeof(uint32_t));
 
     randActions(e);
     setupEnv(e);
     stepEnv(e);
 
-    uint32_t steps = 0;
-    while (steps != numSteps) {
+    uint32_t resets = 0;
+    const uint64_t start = nowNs();
+    for (uint32_t i = 0; i < numSteps; i++) {
+        if (e->needsReset) {
+            resets++;
+        }
         randActions(e);
+
+        const uint64_t stepStart = nowNs();
         stepEnv(e);
-        steps++;
+        latencies[i] = min(nowNs() - stepStart, (uint64_t)UINT32_MAX);
+    }
+    const double seconds = (nowNs() - start) / 1e9;
+
+    qsort(latencies, numSteps, sizeof(uint32_t), compareLatencies);
+    const scenarioResult result = {
+        .steps = numSteps,
+        .seconds = seconds,
+        .stepsPerSec = numSteps / seconds,
+        .p50StepUs = percentileUs(latencies, numSteps, 0.5),
+        .p99StepUs = percentileUs(latencies, numSteps, 0.99),
+        .resets = resets,
+        .resetsPerSec = resets / seconds,
+        .peakRSSKb = peakRSSKb(),
+    };
+
+    fastFree(latencies);
+    destroyToolEnv(&t);
+    return result;
+}
+
+// runs a scenario in a forked child; ru_maxrss is a high water mark for
+// the whole process that never goes down, so scenarios have to run in
+// separate processes for their peak RSS to be comparable
+scenarioResult runScenarioInChild(const scenario *s, const uint32_t numSteps, const uint64_t seed) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        ERRORF("failed to create pipe for scenario %s", s->name);
+    }
+    // anything still buffered would be written by both processes
+    fflush(stdout);
+    fflush(stderr);
+
+    const pid_t pid = fork();
+    if (pid == -1) {
+        ERRORF("failed to fork for scenario %s", s->name);
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        const scenarioResult result = runScenario(s, numSteps, seed);
+        const bool written = write(fds[1], &result, sizeof(result)) == sizeof(result);
+        close(fds[1]);
+        _exit(written ? 0 : 1);
+    }
+
+    close(fds[1]);
+    scenarioResult result = {0};
+    const ssize_t bytesRead = read(fds[0], &result, sizeof(result));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (bytesRead != sizeof(result) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        ERRORF("scenario %s failed", s->name);
+    }
+    return result;
+}
+
+uint8_t addScenario(scenario *scenarios, uint8_t numScenarios, const scenario s) {
+    ASSERT(numScenarios < MAX_SCENARIOS);
+    scenarios[numScenarios] = s;
+    return numScenarios + 1;
+}
+
+// every scenario changes one thing from a 2 drone training env with only
+// agents on a random map, so regressions can be attributed to a feature
+uint8_t buildScenarios(scenario *scenarios) {
+    const scenario base = {
+        .mapIdx = -1,
+        .numDrones = 2,
+        .numAgents = 2,
+        .enableTeams = false,
+        .defaultWeapon = -1,
+        .isTraining = true,
+    };
+    uint8_t numScenarios = 0;
+    scenario s;
+
+    s = base;
+    snprintf(s.name, sizeof(s.name), "base");
+    numScenarios = addScenario(scenarios, numScenarios, s);
+
+    for (uint8_t i = 0; i < NUM_MAPS; i++) {
+        s = base;
+        s.mapIdx = i;
+        snprintf(s.name, sizeof(s.name), "map_%d", i);
+        numScenarios = addScenario(scenarios, numScenarios, s);
+    }
+
+    for (uint8_t numDrones = 3; numDrones <= 4; numDrones++) {
+        s = base;
+        s.numDrones = numDrones;
+        s.numAgents = numDrones;
+        snprintf(s.name, sizeof(s.name), "drones_%d", numDrones);
+        numScenarios = addScenario(scenarios, numScenarios, s);
     }
 
-    destroyEnv(e);
+    // agents vs scripted drones
+    const uint8_t mixes[][2] = {{2, 1}, {3, 1}, {4, 1}, {4, 2}};
+    for (uint8_t i = 0; i < sizeof(mixes) / sizeof(mixes[0]); i++) {
+        s = base;
+        s.numDrones = mixes[i][0];
+        s.numAgents = mixes[i][1];
+        snprintf(s.name, sizeof(s.name), "drones_%d_agents_%d", s.numDrones, s.numAgents);
+        numScenarios = addScenario(scenarios, numScenarios, s);
+    }
+
+    s = base;
+    s.numDrones = 4;
+    s.numAgents = 4;
+    s.enableTeams = true;
+    snprintf(s.name, sizeof(s.name), "teams");
+    numScenarios = addScenario(scenarios, numScenarios, s);
+
+    s = base;
+    s.numDrones = 4;
+    s.numAgents = 2;
+    s.enableTeams = true;
+    snprintf(s.name, sizeof(s.name), "teams_scripted");
+    numScenarios = addScenario(scenarios, numScenarios, s);
+
+    for (uint8_t i = 0; i < NUM_WEAPONS; i++) {
+        s = base;
+        s.defaultWeapon = i;
+        snprintf(s.name, sizeof(s.name), "weapon_%d", i);
+        numScenarios = addScenario(scenarios, numScenarios, s);
+    }
+
+    // eval runs at a higher frame rate with more box2d substeps
+    s = base;
+    s.isTraining = false;
+    snprintf(s.name, sizeof(s.name), "eval");
+    numScenarios = addScenario(scenarios, numScenarios, s);
+
+    s = base;
+    s.numDrones = 4;
+    s.numAgents = 1;
+    s.isTraining = false;
+    snprintf(s.name, sizeof(s.name), "eval_drones_4_agents_1");
+    numScenarios = addScenario(scenarios, numScenarios, s);
+
+    return numScenarios;
+}
+
+void printScenarioResult(const scenario *s, const scenarioResult *r, const bool last) {
+    printf("    {\n");
+    printf("      \"name\": \"%s\",\n", s->name);
+    printf("      \"map\": %d,\n", s->mapIdx);
+    printf("      \"drones\": %d,\n", s->numDrones);
+    printf("      \"agents\": %d,\n", s->numAgents);
+    printf("      \"teams\": %s,\n", s->enableTeams ? "true" : "false");
+    printf("      \"default_weapon\": %d,\n", s->defaultWeapon);
+    printf("      \"training\": %s,\n", s->isTraining ? "true" : "false");
+    printf("      \"steps\": %u,\n", r->steps);
+    printf("      \"seconds\": %f,\n", r->seconds);
+    printf("      \"steps_per_sec\": %f,\n", r->stepsPerSec);
+    printf("      \"p50_step_us\": %f,\n", r->p50StepUs);
+    printf("      \"p99_step_us\": %f,\n", r->p99StepUs);
+    printf("      \"resets\": %u,\n", r->resets);
+    printf("      \"resets_per_sec\": %f,\n", r->resetsPerSec);
+    printf("      \"peak_rss_kb\": %ld\n", r->peakRSSKb);
+    printf("    }%s\n", last ? "" : ",");
+    fflush(stdout);
+}
+
+// runs every scenario and prints the results as JSON; seeds are fixed so
+// results can be compared across commits
+void benchmarkSuite(const uint32_t numSteps, const char *mapPathsFile) {
+    scenario scenarios[MAX_SCENARIOS];
+    const uint8_t numScenarios = buildScenarios(scenarios);
+
+    // maps are shared by every env, so only set them up once
+    toolEnv mapsEnv = createToolEnv(2, 2, -1, BENCHMARK_SEED, false, true);
+    initToolMaps(mapsEnv.e, mapPathsFile);
+    destroyToolEnv(&mapsEnv);
+
+    printf("{\n");
+    printf("  \"steps_per_scenario\": %u,\n", numSteps);
+    printf("  \"seed\": %d,\n", BENCHMARK_SEED);
+    printf("  \"scenarios\": [\n");
+    for (uint8_t i = 0; i < numScenarios; i++) {
+        const scenarioResult result = runScenarioInChild(&scenarios[i], numSteps, BENCHMARK_SEED + i);
+        printScenarioResult(&scenarios[i], &result, i == numScenarios - 1);
+    }
+    printf("  ]\n");
+    printf("}\n");
+
     destroyMaps();
+}
+
+// measures how long resetting an env takes; every reset picks a random
+// map so this includes the cost of switching maps
+void resetPerfTest(const uint32_t numResets) {
+    toolEnv t = createToolEnv(2, 2, -1, time(NULL), false, true);
+    env *e = t.e;
+    initMaps(e);
+    setupEnv(e);
+
+    const uint64_t start = nowNs();
+    for (uint32_t i = 0; i < numResets; i++) {
+        resetEnv(e);
+    }
+    const double elapsed = (nowNs() - start) / 1e9;
+    printf("resets: %u, seconds: %f, resets/sec: %f, us/reset: %f\n", numResets, elapsed, numResets / elapsed, (elapsed * 1e6) / numResets);
 
-    free(obs);
-    fastFree(actions);
-    fastFree(rewards);
-    fastFree(masks);
-    fastFree(terminals);
-    fastFree(truncations);
-    destroyLogBuffer(logs);
-    fastFree(e);
+    destroyToolEnv(&t);
+    destroyMaps();
 }
 
-int main(void) {
-    perfTest(2500000);
+// usage:
+//   benchmark [steps per scenario] [map paths file]
+//   benchmark reset
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        resetPerfTest(100000);
+        return 0;
+    }
+
+    uint32_t numSteps = DEFAULT_SCENARIO_STEPS;
+    if (argc > 1) {
+        numSteps = strtoul(argv[1], NULL, 10);
+        if (numSteps == 0) {
+            fprintf(stderr, "invalid number of steps: %s\n", argv[1]);
+            return 1;
+        }
+    }
+    const char *mapPathsFile = NULL;
+    if (argc > 2) {
+        mapPathsFile = argv[2];
+    }
+
+    benchmarkSuite(numSteps, mapPathsFile);
     return 0;
 }
@@ -0,0 +1,192 @@
+#include <stdio.h>
+
+#include "env.h"
+#include "tool_env.h"
+
+// checks that walking the map grid to find static walls between two
+// points agrees with box2d ray casts on every map, before and after
+// sudden death walls are placed; segments are random, run along the
+// edges of walls, or pass through the corners of walls, as those are
+// the cases the grid walk is most likely to get wrong
+
+#define CHECK_SEED 42
+#define NUM_CHECK_DRONES 2
+#define DEFAULT_SEGMENTS_PER_MAP 100000
+#define MAX_PRINTED_MISMATCHES 10
+// how far segments along edges and through corners are moved off of
+// the edge or corner, a segment exactly on an edge is also checked
+#define EDGE_NUDGE 0.05f
+
+enum segmentKind {
+    RANDOM_SEGMENT,
+    EDGE_SEGMENT,
+    CORNER_SEGMENT,
+    NUM_SEGMENT_KINDS,
+};
+
+const char *segmentKindNames[] = {"random", "edge", "corner"};
+
+typedef struct checkBounds {
+    b2Vec2 min;
+    b2Vec2 max;
+} checkBounds;
+
+// the area covered by the map grid, padded by a cell on every side so
+// segments can start and end outside of the map
+checkBounds mapGridBounds(const env *e) {
+    const float halfWidth = ((float)e->map->columns * WALL_THICKNESS) / 2.0f;
+    const float halfHeight = ((float)e->map->rows * WALL_THICKNESS) / 2.0f;
+    return (checkBounds){
+        .min = {.x = -halfWidth - WALL_THICKNESS, .y = -halfHeight - WALL_THICKNESS},
+        .max = {.x = halfWidth + WALL_THICKNESS, .y = halfHeight + WALL_THICKNESS},
+    };
+}
+
+b2Vec2 randPos(env *e, const checkBounds *bounds) {
+    return (b2Vec2){
+        .x = randFloat(&e->randState, bounds->min.x, bounds->max.x),
+        .y = randFloat(&e->randState, bounds->min.y, bounds->max.y),
+    };
+}
+
+float randNudge(env *e) {
+    switch (randInt(&e->randState, 0, 2)) {
+    case 0:
+        return -EDGE_NUDGE;
+    case 1:
+        return 0.0f;
+    default:
+        return EDGE_NUDGE;
+    }
+}
+
+// returns the center of a random cell holding a static wall, the map
+// must have at least one
+b2Vec2 randWallCellPos(env *e) {
+    while (true) {
+        const mapCell *cell = &e->cells[randInt(&e->randState, 0, e->numCells - 1)];
+        if (cell->ent != NULL && entityTypeIsWall(cell->ent->type)) {
+            return cell->pos;
+        }
+    }
+}
+
+void makeSegment(env *e, const checkBounds *bounds, const enum segmentKind kind, b2Vec2 *startPos, b2Vec2 *endPos) {
+    const float halfCell = WALL_THICKNESS / 2.0f;
+
+    switch (kind) {
+    case RANDOM_SEGMENT:
+        *startPos = randPos(e, bounds);
+        *endPos = randPos(e, bounds);
+        break;
+    case EDGE_SEGMENT: {
+        // a horizontal or vertical segment on or right next to one of
+        // the edges of a wall cell
+        const b2Vec2 cellPos = randWallCellPos(e);
+        const float side = randInt(&e->randState, 0, 1) == 0 ? -halfCell : halfCell;
+        const float nudge = randNudge(e);
+        *startPos = randPos(e, bounds);
+        *endPos = randPos(e, bounds);
+        if (randInt(&e->randState, 0, 1) == 0) {
+            startPos->x = cellPos.x + side + nudge;
+            endPos->x = startPos->x;
+        } else {
+            startPos->y = cellPos.y + side + nudge;
+            endPos->y = startPos->y;
+        }
+        break;
+    }
+    case CORNER_SEGMENT: {
+        // a segment from a random point through or right next to one
+        // of the corners of a wall cell
+        const b2Vec2 cellPos = randWallCellPos(e);
+        const b2Vec2 corner = {
+            .x = cellPos.x + (randInt(&e->randState, 0, 1) == 0 ? -halfCell : halfCell) + randNudge(e),
+            .y = cellPos.y + (randInt(&e->randState, 0, 1) == 0 ? -halfCell : halfCell) + randNudge(e),
+        };
+        *startPos = randPos(e, bounds);
+        *endPos = b2MulAdd(corner, randFloat(&e->randState, 0.1f, 1.0f), b2Sub(corner, *startPos));
+        break;
+    }
+    default:
+        ERRORF("unknown segment kind %d", kind);
+    }
+}
+
+// returns the number of segments the grid walk and box2d disagree on
+uint32_t checkMap(env *e, const uint32_t numSegments, uint32_t *printedMismatches) {
+    const b2QueryFilter filter = {.categoryBits = PROJECTILE_SHAPE, .maskBits = WALL_SHAPE};
+    const checkBounds bounds = mapGridBounds(e);
+
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < numSegments; i++) {
+        const enum segmentKind kind = i % NUM_SEGMENT_KINDS;
+        b2Vec2 startPos;
+        b2Vec2 endPos;
+        makeSegment(e, &bounds, kind, &startPos, &endPos);
+        if (b2DistanceSquared(startPos, endPos) == 0.0f) {
+            continue;
+        }
+
+        const bool hit = segmentHitsStaticWall(e, startPos, endPos, NULL, NULL);
+        if (staticWallSightAgrees(e, startPos, endPos, NULL, filter, NULL, hit)) {
+            continue;
+        }
+
+        mismatches++;
+        if (*printedMismatches < MAX_PRINTED_MISMATCHES) {
+            (*printedMismatches)++;
+            fprintf(stderr, "map %d: %s segment (%f, %f) to (%f, %f) grid hit: %d\n", e->mapIdx, segmentKindNames[kind], startPos.x, startPos.y, endPos.x, endPos.y, hit);
+        }
+    }
+
+    return mismatches;
+}
+
+// usage:
+//   check_visibility [segments per map] [map paths file]
+int main(int argc, char **argv) {
+    uint32_t numSegments = DEFAULT_SEGMENTS_PER_MAP;
+    if (argc > 1) {
+        numSegments = strtoul(argv[1], NULL, 10);
+    }
+    if (numSegments == 0) {
+        fprintf(stderr, "segments per map must be greater than 0\n");
+        return 1;
+    }
+
+    const char *mapPathsFile = NULL;
+    if (argc > 2) {
+        mapPathsFile = argv[2];
+    }
+
+    toolEnv t = createToolEnv(NUM_CHECK_DRONES, NUM_CHECK_DRONES, 0, CHECK_SEED, false, true);
+    env *e = t.e;
+    initToolMaps(e, mapPathsFile);
+    setupEnv(e);
+
+    uint32_t totalMismatches = 0;
+    uint32_t printedMismatches = 0;
+    for (uint8_t mapIdx = 0; mapIdx < NUM_MAPS; mapIdx++) {
+        e->pinnedMapIdx = mapIdx;
+        resetEnv(e);
+        const uint32_t mismatches = checkMap(e, numSegments, &printedMismatches);
+
+        e->stepsLeft = 0;
+        e->suddenDeathSteps = 0;
+        handleSuddenDeath(e);
+        const uint32_t suddenDeathMismatches = checkMap(e, numSegments, &printedMismatches);
+
+        printf("map %d: %u segments, %u mismatches, %u mismatches with sudden death walls\n", mapIdx, numSegments, mismatches, suddenDeathMismatches);
+        totalMismatches += mismatches + suddenDeathMismatches;
+    }
+
+    destroyToolEnv(&t);
+    destroyMaps();
+
+    if (totalMismatches != 0) {
+        fprintf(stderr, "grid line of sight disagreed with box2d on %u segments\n", totalMismatches);
+        return 1;
+    }
+    return 0;
+}
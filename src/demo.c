@@ -22,7 +22,7 @@ int main(void) {
     uint8_t *masks = fastCalloc(NUM_DRONES, sizeof(uint8_t));
     uint8_t *terminals = fastCalloc(NUM_DRONES, sizeof(uint8_t));
     uint8_t *truncations = fastCalloc(NUM_DRONES, sizeof(uint8_t));
-    logBuffer *logs = createLogBuffer(LOG_BUFFER_SIZE);
+    logBuffer *logs = createLogBuffer();
 
     rayClient *client = createRayClient();
     e->client = client;
@@ -29,69 +29,145 @@ typedef struct Vector2 {
 } Vector2;
 #endif
 
+// times phases of stepping and adds the elapsed microseconds to the
+// env's step timings; compiled out unless STEP_TIMERS is defined
+#if defined(STEP_TIMERS) && !defined(AUTOPXD)
+#define STEP_TIMER_START(phase) const uint64_t _##phase##TimerStart = nowNs()
+#define STEP_TIMER_END(e, phase) (e)->stepTimes.phase += (nowNs() - _##phase##TimerStart) / 1000.0
+#else
+#define STEP_TIMER_START(phase)
+#define STEP_TIMER_END(e, phase)
+#endif
+
 const uint8_t THREE_BIT_MASK = 0x7;
 const uint8_t FOUR_BIT_MASK = 0xf;
 
-logBuffer *createLogBuffer(uint16_t capacity) {
+#ifndef AUTOPXD
+#define LOG_AGGREGATE_NONE 2
+
+static void initLogAggregate(logAggregate *aggregate) {
+    aggregate->count = 0;
+    memset(aggregate->fields, 0x0, sizeof(aggregate->fields));
+    initQuantileSketch(&aggregate->length);
+    for (uint8_t i = 0; i < _MAX_DRONES; i++) {
+        initQuantileSketch(&aggregate->reward[i]);
+    }
+}
+
+logBuffer *createLogBuffer() {
     logBuffer *logs = fastCalloc(1, sizeof(logBuffer));
-    logs->logs = fastCalloc(capacity, sizeof(logEntry));
-    logs->size = 0;
-    logs->capacity = capacity;
+    initLogAggregate(&logs->aggregates[0]);
+    initLogAggregate(&logs->aggregates[1]);
+    atomic_init(&logs->active, 0);
+    atomic_init(&logs->writing, LOG_AGGREGATE_NONE);
     return logs;
 }
 
 void destroyLogBuffer(logBuffer *buffer) {
-    fastFree(buffer->logs);
     fastFree(buffer);
 }
 
+// updates the running stats of a log buffer with a finished episode in
+// constant time and memory; must only be called by a single thread at a
+// time per log buffer
 void addLogEntry(logBuffer *logs, logEntry *log) {
-    if (logs->size == logs->capacity) {
-        return;
+    // claim the active aggregate; if it was swapped before the claim was
+    // visible, claim the new one instead so the collecting thread never
+    // reads an aggregate that's being updated
+    uint8_t active;
+    do {
+        active = atomic_load(&logs->active);
+        atomic_store(&logs->writing, active);
+    } while (atomic_load(&logs->active) != active);
+
+    logAggregate *aggregate = &logs->aggregates[active];
+    aggregate->count++;
+    const float *fields = (const float *)log;
+    for (uint16_t i = 0; i < NUM_LOG_FIELDS; i++) {
+        runningStatAdd(&aggregate->fields[i], aggregate->count, fields[i]);
+    }
+    quantileSketchAdd(&aggregate->length, log->length);
+    for (uint8_t i = 0; i < _MAX_DRONES; i++) {
+        quantileSketchAdd(&aggregate->reward[i], log->stats[i].reward);
+    }
+
+    atomic_store_explicit(&logs->writing, LOG_AGGREGATE_NONE, memory_order_release);
+}
+
+// moves every episode logged to a log buffer into dst; must only be
+// called by a single thread at a time per log buffer, but can be called
+// while another thread is adding episodes
+void drainLogBuffer(logBuffer *logs, logAggregate *dst) {
+    const uint8_t prevActive = atomic_load(&logs->active);
+    atomic_store(&logs->active, prevActive ^ 1);
+    // wait for an in progress update of the previously active aggregate
+    // to finish, updates are short and don't block
+    while (atomic_load(&logs->writing) == prevActive) {
+        CPU_RELAX();
+    }
+
+    logAggregate *src = &logs->aggregates[prevActive];
+    for (uint16_t i = 0; i < NUM_LOG_FIELDS; i++) {
+        runningStatMerge(&dst->fields[i], dst->count, &src->fields[i], src->count);
+    }
+    dst->count += src->count;
+    quantileSketchMerge(&dst->length, &src->length);
+    for (uint8_t i = 0; i < _MAX_DRONES; i++) {
+        quantileSketchMerge(&dst->reward[i], &src->reward[i]);
     }
-    logs->logs[logs->size] = *log;
-    logs->size += 1;
+    initLogAggregate(src);
 }
 
-logEntry aggregateAndClearLogBuffer(uint8_t numDrones, logBuffer *logs) {
-    logEntry log = {0};
-    if (logs->size == 0) {
-        return log;
-    }
-
-    DEBUG_LOGF("aggregating logs, size: %d", logs->size);
-
-    const float logSize = logs->size;
-    for (uint16_t i = 0; i < logs->size; i++) {
-        log.length += logs->logs[i].length / logSize;
-        log.ties += logs->logs[i].ties / logSize;
-
-        for (uint8_t j = 0; j < numDrones; j++) {
-            log.stats[j].reward += logs->logs[i].stats[j].reward / logSize;
-            log.stats[j].wins += logs->logs[i].stats[j].wins / logSize;
-
-            log.stats[j].distanceTraveled += logs->logs[i].stats[j].distanceTraveled / logSize;
-            log.stats[j].absDistanceTraveled += logs->logs[i].stats[j].absDistanceTraveled / logSize;
-            log.stats[j].brakeTime += logs->logs[i].stats[j].brakeTime / logSize;
-            log.stats[j].totalBursts += logs->logs[i].stats[j].totalBursts / logSize;
-            log.stats[j].burstsHit += logs->logs[i].stats[j].burstsHit / logSize;
-            log.stats[j].energyEmptied += logs->logs[i].stats[j].energyEmptied / logSize;
-
-            for (uint8_t k = 0; k < NUM_WEAPONS; k++) {
-                log.stats[j].shotsFired[k] += logs->logs[i].stats[j].shotsFired[k] / logSize;
-                log.stats[j].shotsHit[k] += logs->logs[i].stats[j].shotsHit[k] / logSize;
-                log.stats[j].shotsTaken[k] += logs->logs[i].stats[j].shotsTaken[k] / logSize;
-                log.stats[j].ownShotsTaken[k] += logs->logs[i].stats[j].ownShotsTaken[k] / logSize;
-                log.stats[j].weaponsPickedUp[k] += logs->logs[i].stats[j].weaponsPickedUp[k] / logSize;
-                log.stats[j].shotDistances[k] += logs->logs[i].stats[j].shotDistances[k] / logSize;
-            }
-        }
+static logDistribution summarizeSketch(const quantileSketch *sketch) {
+    logDistribution dist = {0};
+    if (sketch->count == 0) {
+        return dist;
+    }
+    dist.min = sketch->min;
+    dist.max = sketch->max;
+    dist.p10 = quantileSketchQuantile(sketch, 0.1f);
+    dist.p50 = quantileSketchQuantile(sketch, 0.5f);
+    dist.p90 = quantileSketchQuantile(sketch, 0.9f);
+    dist.p99 = quantileSketchQuantile(sketch, 0.99f);
+    return dist;
+}
+
+logSummary summarizeLogAggregate(const logAggregate *aggregate, const uint8_t numDrones) {
+    logSummary summary = {0};
+    if (aggregate->count == 0) {
+        return summary;
     }
 
-    logs->size = 0;
-    return log;
+    DEBUG_LOGF("aggregating logs, size: %d", aggregate->count);
+
+    summary.episodes = aggregate->count;
+    float *mean = (float *)&summary.mean;
+    float *stddev = (float *)&summary.stddev;
+    for (uint16_t i = 0; i < NUM_LOG_FIELDS; i++) {
+        mean[i] = aggregate->fields[i].mean;
+        stddev[i] = runningStatStddev(&aggregate->fields[i], aggregate->count);
+    }
+    summary.length = summarizeSketch(&aggregate->length);
+    for (uint8_t i = 0; i < numDrones; i++) {
+        summary.reward[i] = summarizeSketch(&aggregate->reward[i]);
+    }
+    return summary;
 }
 
+logSummary aggregateAndClearLogBuffer(uint8_t numDrones, logBuffer *logs) {
+    logAggregate *aggregate = fastMalloc(sizeof(logAggregate));
+    initLogAggregate(aggregate);
+    drainLogBuffer(logs, aggregate);
+    const logSummary summary = summarizeLogAggregate(aggregate, numDrones);
+    fastFree(aggregate);
+    return summary;
+}
+#else
+logBuffer *createLogBuffer();
+void destroyLogBuffer(logBuffer *buffer);
+logSummary aggregateAndClearLogBuffer(uint8_t numDrones, logBuffer *logs);
+#endif
+
 // returns a cell index that is closest to pos that isn't cellIdx
 uint16_t findNearestCell(const env *e, const b2Vec2 pos, const uint16_t cellIdx) {
     uint16_t closestCell = cellIdx;
@@ -108,7 +184,7 @@ uint16_t findNearestCell(const env *e, const b2Vec2 pos, const uint16_t cellIdx)
             continue;
         }
         const int16_t newCellIdx = cellIndex(e, newCellCol, newCellRow);
-        const mapCell *cell = safe_array_get_at(e->cells, newCellIdx);
+        const mapCell *cell = &e->cells[newCellIdx];
         if (minDistance != fminf(minDistance, b2DistanceSquared(pos, cell->pos))) {
             closestCell = newCellIdx;
         }
@@ -127,8 +203,62 @@ static inline float scaleAmmo(const env *e, const droneEntity *drone) {
     return scaledAmmo;
 }
 
+// computes entity data shared by every agent's observations so it's
+// only computed once per step
+void computeObsEntityCache(env *e) {
+    obsEntityCache *cache = &e->obsCache;
+
+    // compute map layout, and discretized positions of weapon pickups
+    if (!e->suddenDeathWallsPlaced) {
+        // copy precomputed map layout if sudden death walls haven't been placed
+        memcpy(cache->mapLayout, e->map->packedLayout, e->numCells * sizeof(uint8_t));
+
+        for (size_t i = 0; i < slotMapSize(e->pickups); i++) {
+            const weaponPickupEntity *pickup = slotMapGetAt(e->pickups, i);
+            if (pickup->mapCellIdx == -1) {
+                continue;
+            }
+            cache->mapLayout[pickup->mapCellIdx] |= 1 << 3;
+        }
+    } else {
+        // sudden death walls have been placed so compute map layout manually
+        for (uint16_t i = 0; i < e->numCells; i++) {
+            const mapCell *cell = &e->cells[i];
+            cache->mapLayout[i] = 0;
+            if (cell->ent == NULL) {
+                continue;
+            }
+
+            if (entityTypeIsWall(cell->ent->type)) {
+                cache->mapLayout[i] = ((cell->ent->type + 1) & TWO_BIT_MASK) << 5;
+            } else if (cell->ent->type == WEAPON_PICKUP_ENTITY) {
+                cache->mapLayout[i] |= 1 << 3;
+            }
+        }
+    }
+
+    // compute transforms and discretized locations of floating walls
+    ASSERTF(slotMapSize(e->floatingWalls) <= MAX_FLOATING_WALLS, "floating walls: %zu", (size_t)slotMapSize(e->floatingWalls));
+    for (size_t i = 0; i < slotMapSize(e->floatingWalls); i++) {
+        const wallEntity *wall = slotMapGetAt(e->floatingWalls, i);
+        cache->floatingWallTransforms[i] = b2Body_GetTransform(wall->bodyID);
+        if (wall->mapCellIdx == -1) {
+            continue;
+        }
+        cache->mapLayout[wall->mapCellIdx] = ((wall->type + 1) & TWO_BIT_MASK) << 5;
+        cache->mapLayout[wall->mapCellIdx] |= 1 << 4;
+    }
+
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        const droneEntity *drone = safe_array_get_at(e->drones, i);
+        cache->droneAccels[i] = b2Sub(drone->velocity, drone->lastVelocity);
+        cache->droneAimAngles[i] = atan2f(drone->lastAim.y, drone->lastAim.x);
+    }
+}
+
 // fills a small 2D grid centered around the agent with discretized
-// walls, floating walls, weapon pickups, and drone positions
+// walls, floating walls, weapon pickups, and drone positions;
+// computeObsEntityCache must have been called this step
 void computeMapObs(env *e, const uint8_t agentIdx, const uint16_t obsStartOffset) {
     droneEntity *drone = safe_array_get_at(e->drones, agentIdx);
     const uint8_t droneCellCol = drone->mapCellIdx % e->map->columns;
@@ -155,73 +285,12 @@ void computeMapObs(env *e, const uint8_t agentIdx, const uint16_t obsStartOffset
     }
     uint16_t offset = startOffset;
 
-    // compute map layout, and discretized positions of weapon pickups
-    if (!e->suddenDeathWallsPlaced) {
-        // copy precomputed map layout if sudden death walls haven't been placed
-        const int8_t numCols = endCol - startCol + 1;
-        for (int8_t row = startRow; row <= endRow; row++) {
-            const int16_t cellIdx = cellIndex(e, startCol, row);
-            memcpy(e->obs + offset, e->map->packedLayout + cellIdx, numCols * sizeof(uint8_t));
-            offset += MAP_OBS_COLUMNS;
-        }
-
-        // compute discretized location of weapon pickups on grid
-        for (size_t i = 0; i < cc_array_size(e->pickups); i++) {
-            const weaponPickupEntity *pickup = safe_array_get_at(e->pickups, i);
-            const uint8_t cellCol = pickup->mapCellIdx % e->map->columns;
-            if (cellCol < startCol || cellCol > endCol) {
-                continue;
-            }
-            const uint8_t cellRow = pickup->mapCellIdx / e->map->columns;
-            if (cellRow < startRow || cellRow > endRow) {
-                continue;
-            }
-
-            offset = startOffset + ((cellCol - startCol) + ((cellRow - startRow) * MAP_OBS_COLUMNS));
-            ASSERTF(offset <= startOffset + MAP_OBS_SIZE, "offset: %d", offset);
-            e->obs[offset] |= 1 << 3;
-        }
-    } else {
-        // sudden death walls have been placed so compute may layout manually
-        const int8_t colPadding = obsColOffset + (obsEndCol - endCol);
-        for (int8_t row = startRow; row <= endRow; row++) {
-            for (int8_t col = startCol; col <= endCol; col++) {
-                const int16_t cellIdx = cellIndex(e, col, row);
-                const mapCell *cell = safe_array_get_at(e->cells, cellIdx);
-                if (cell->ent == NULL) {
-                    offset++;
-                    continue;
-                }
-
-                if (entityTypeIsWall(cell->ent->type)) {
-                    e->obs[offset] = ((cell->ent->type + 1) & TWO_BIT_MASK) << 5;
-                } else if (cell->ent->type == WEAPON_PICKUP_ENTITY) {
-                    e->obs[offset] |= 1 << 3;
-                }
-
-                offset++;
-            }
-            offset += colPadding;
-        }
-        ASSERTF(offset <= startOffset + MAP_OBS_SIZE, "offset %u startOffset %u", offset, startOffset);
-    }
-
-    // compute discretized locations of floating walls on grid
-    for (size_t i = 0; i < cc_array_size(e->floatingWalls); i++) {
-        const wallEntity *wall = safe_array_get_at(e->floatingWalls, i);
-        const uint8_t cellCol = wall->mapCellIdx % e->map->columns;
-        if (cellCol < startCol || cellCol > endCol) {
-            continue;
-        }
-        const uint8_t cellRow = wall->mapCellIdx / e->map->columns;
-        if (cellRow < startRow || cellRow > endRow) {
-            continue;
-        }
-
-        offset = startOffset + ((cellCol - startCol) + ((cellRow - startRow) * MAP_OBS_COLUMNS));
-        ASSERTF(offset <= startOffset + MAP_OBS_SIZE, "offset: %d", offset);
-        e->obs[offset] = ((wall->type + 1) & TWO_BIT_MASK) << 5;
-        e->obs[offset] |= 1 << 4;
+    // copy map layout with weapon pickups and floating walls
+    const int8_t numCols = endCol - startCol + 1;
+    for (int8_t row = startRow; row <= endRow; row++) {
+        const int16_t cellIdx = cellIndex(e, startCol, row);
+        memcpy(e->obs + offset, e->obsCache.mapLayout + cellIdx, numCols * sizeof(uint8_t));
+        offset += MAP_OBS_COLUMNS;
     }
 
     // compute discretized location and index of drones on grid
@@ -260,7 +329,8 @@ void computeMapObs(env *e, const uint8_t agentIdx, const uint16_t obsStartOffset
 }
 
 #ifndef AUTOPXD
-// computes observations for N nearest walls, floating walls, and weapon pickups
+// computes observations for N nearest walls, floating walls, and weapon
+// pickups; computeObsEntityCache must have been called this step
 void computeNearObs(env *e, const droneEntity *drone, const uint16_t discreteObsStart, float *continuousObs) {
     nearEntity nearWalls[NUM_NEAR_WALL_OBS];
     findNearWalls(e, drone, nearWalls, NUM_NEAR_WALL_OBS);
@@ -285,27 +355,28 @@ void computeNearObs(env *e, const droneEntity *drone, const uint16_t discreteObs
         continuousObs[offset] = scaleValue(wallRelPos.y, MAX_Y_POS, false);
     }
 
-    if (cc_array_size(e->floatingWalls) != 0) {
+    if (slotMapSize(e->floatingWalls) != 0) {
         // find N nearest floating walls
         nearEntity nearFloatingWalls[MAX_FLOATING_WALLS] = {0};
-        for (uint8_t i = 0; i < cc_array_size(e->floatingWalls); i++) {
-            wallEntity *wall = safe_array_get_at(e->floatingWalls, i);
+        for (uint8_t i = 0; i < slotMapSize(e->floatingWalls); i++) {
+            wallEntity *wall = slotMapGetAt(e->floatingWalls, i);
             const nearEntity nearEnt = {
+                .idx = i,
                 .entity = wall,
                 .distanceSquared = b2DistanceSquared(wall->pos, drone->pos),
             };
             nearFloatingWalls[i] = nearEnt;
         }
-        insertionSort(nearFloatingWalls, cc_array_size(e->floatingWalls));
+        insertionSort(nearFloatingWalls, slotMapSize(e->floatingWalls));
 
         // compute type, position, angle and velocity of N nearest floating walls
-        for (uint8_t i = 0; i < cc_array_size(e->floatingWalls); i++) {
+        for (uint8_t i = 0; i < slotMapSize(e->floatingWalls); i++) {
             if (i == NUM_FLOATING_WALL_OBS) {
                 break;
             }
             const wallEntity *wall = nearFloatingWalls[i].entity;
 
-            const b2Transform wallTransform = b2Body_GetTransform(wall->bodyID);
+            const b2Transform wallTransform = e->obsCache.floatingWallTransforms[nearFloatingWalls[i].idx];
             const b2Vec2 wallRelPos = b2Sub(wallTransform.p, drone->pos);
             const float angle = b2Rot_GetAngle(wallTransform.q);
 
@@ -325,21 +396,21 @@ void computeNearObs(env *e, const droneEntity *drone, const uint16_t discreteObs
         }
     }
 
-    if (cc_array_size(e->pickups) != 0) {
+    if (slotMapSize(e->pickups) != 0) {
         // find N nearest weapon pickups
         nearEntity nearPickups[MAX_WEAPON_PICKUPS] = {0};
-        for (uint8_t i = 0; i < cc_array_size(e->pickups); i++) {
-            weaponPickupEntity *pickup = safe_array_get_at(e->pickups, i);
+        for (uint8_t i = 0; i < slotMapSize(e->pickups); i++) {
+            weaponPickupEntity *pickup = slotMapGetAt(e->pickups, i);
             const nearEntity nearEnt = {
                 .entity = pickup,
                 .distanceSquared = b2DistanceSquared(pickup->pos, drone->pos),
             };
             nearPickups[i] = nearEnt;
         }
-        insertionSort(nearPickups, cc_array_size(e->pickups));
+        insertionSort(nearPickups, slotMapSize(e->pickups));
 
         // compute type and location of N nearest weapon pickups
-        for (uint8_t i = 0; i < cc_array_size(e->pickups); i++) {
+        for (uint8_t i = 0; i < slotMapSize(e->pickups); i++) {
             if (i == NUM_WEAPON_PICKUP_OBS) {
                 break;
             }
@@ -361,12 +432,52 @@ void computeNearObs(env *e, const droneEntity *drone, const uint16_t discreteObs
 }
 #endif
 
+// autopxd2 can't parse _Float16
+#ifndef AUTOPXD
+// converts continuous observations computed as floats to the env's obs
+// format and writes them to dst
+static void packContinuousObs(const env *e, uint8_t *dst, const float *src, const uint16_t size) {
+    switch (e->obsFormat) {
+    case OBS_FORMAT_FLOAT16: {
+        _Float16 *halfDst = (_Float16 *)dst;
+        for (uint16_t i = 0; i < size; i++) {
+            halfDst[i] = (_Float16)src[i];
+        }
+        break;
+    }
+    case OBS_FORMAT_INT8: {
+        int8_t *intDst = (int8_t *)dst;
+        for (uint16_t i = 0; i < size; i++) {
+            intDst[i] = (int8_t)lrintf(fminf(fmaxf(src[i], -1.0f), 1.0f) * INT8_OBS_SCALE);
+        }
+        break;
+    }
+    default:
+        ERRORF("unknown obs format %d", e->obsFormat);
+    }
+}
+#endif
+
 void computeObs(env *e) {
+    // continuous observations are computed as floats directly into the
+    // obs buffer, if they're stored in a different format they're
+    // computed here and converted after
+    const uint16_t numContinuousObs = continuousObsSize(e->numDrones);
+    float unpackedContinuousObs[MAX_CONTINUOUS_OBS_SIZE];
+
+    computeObsEntityCache(e);
+
     for (uint8_t agentIdx = 0; agentIdx < e->numAgents; agentIdx++) {
         droneEntity *agentDrone = safe_array_get_at(e->drones, agentIdx);
         // if the drone is dead, only compute observations if it died
         // this step and it isn't out of bounds
         if (agentDrone->livesLeft == 0 && (!agentDrone->diedThisStep || agentDrone->mapCellIdx == -1)) {
+            // the back buffer holds observations from before the last
+            // publish, keep the agent's observations the same as last step
+            if (e->publishedObs != NULL) {
+                const uint16_t obsStart = e->obsBytes * agentIdx;
+                memcpy(e->obs + obsStart, e->publishedObs + obsStart, e->obsBytes);
+            }
             continue;
         }
 
@@ -380,16 +491,20 @@ void computeObs(env *e) {
         uint16_t continuousObsOffset;
         const uint16_t continuousObsStart = discreteObsStart + e->discreteObsBytes;
         float *continuousObs = (float *)(e->obs + continuousObsStart);
+        if (e->obsFormat != OBS_FORMAT_FLOAT32) {
+            continuousObs = unpackedContinuousObs;
+            memset(continuousObs, 0x0, numContinuousObs * sizeof(float));
+        }
 
         computeNearObs(e, agentDrone, discreteObsStart, continuousObs);
 
         // compute type and location of N projectiles
-        for (size_t i = 0; i < cc_array_size(e->projectiles); i++) {
+        for (size_t i = 0; i < slotMapSize(e->projectiles); i++) {
             // TODO: handle better
             if (i == NUM_PROJECTILE_OBS) {
                 break;
             }
-            const projectileEntity *projectile = safe_array_get_at(e->projectiles, i);
+            const projectileEntity *projectile = slotMapGetAt(e->projectiles, i);
 
             discreteObsOffset = discreteObsStart + PROJECTILE_DRONE_OBS_OFFSET + i;
             ASSERTF(discreteObsOffset <= discreteObsStart + PROJECTILE_WEAPONS_OBS_OFFSET, "offset: %d", discreteObsOffset);
@@ -432,9 +547,9 @@ void computeObs(env *e) {
 
             const b2Vec2 enemyDroneRelPos = b2Sub(enemyDrone->pos, agentDrone->pos);
             const float enemyDroneDistance = b2Distance(enemyDrone->pos, agentDrone->pos);
-            const b2Vec2 enemyDroneAccel = b2Sub(enemyDrone->velocity, enemyDrone->lastVelocity);
+            const b2Vec2 enemyDroneAccel = e->obsCache.droneAccels[i];
             const b2Vec2 enemyDroneRelNormPos = b2Normalize(b2Sub(enemyDrone->pos, agentDrone->pos));
-            const float enemyDroneAimAngle = atan2f(enemyDrone->lastAim.y, enemyDrone->lastAim.x);
+            const float enemyDroneAimAngle = e->obsCache.droneAimAngles[i];
             float enemyDroneBraking = 0.0f;
             if (enemyDrone->braking) {
                 enemyDroneBraking = 1.0f;
@@ -475,7 +590,7 @@ void computeObs(env *e) {
 
         // compute active drone observations
         continuousObsOffset = ENEMY_DRONE_OBS_OFFSET + ((e->numDrones - 1) * ENEMY_DRONE_OBS_SIZE);
-        const b2Vec2 agentDroneAccel = b2Sub(agentDrone->velocity, agentDrone->lastVelocity);
+        const b2Vec2 agentDroneAccel = e->obsCache.droneAccels[agentIdx];
         float agentDroneBraking = 0.0f;
         if (agentDrone->braking) {
             agentDroneBraking = 1.0f;
@@ -509,7 +624,61 @@ void computeObs(env *e) {
 
         ASSERTF(continuousObsOffset == ENEMY_DRONE_OBS_OFFSET + ((e->numDrones - 1) * ENEMY_DRONE_OBS_SIZE) + DRONE_OBS_SIZE, "offset: %d", continuousObsOffset);
         continuousObs[continuousObsOffset] = scaleValue(e->stepsLeft, e->totalSteps, true);
+
+        if (e->obsFormat != OBS_FORMAT_FLOAT32) {
+            packContinuousObs(e, e->obs + continuousObsStart, continuousObs, numContinuousObs);
+        }
+    }
+}
+
+// sets how continuous observations are stored, must be called before
+// the env is set up; the obs buffer passed to initEnv must have
+// formattedObsBytes(numDrones, format) bytes for every agent
+void setObsFormat(env *e, const enum obsFormat format) {
+    e->obsFormat = format;
+    e->obsBytes = formattedObsBytes(e->numDrones, format);
+}
+
+// makes observations double buffered; observations are computed into
+// backObs while the buffer passed to initEnv holds the published ones,
+// and publishObs swaps them so readers never see partly written obs
+void initObsDoubleBuffer(env *e, uint8_t *backObs) {
+    e->publishedObs = e->obs;
+    e->obs = backObs;
+    e->publishedObsIdx = 0;
+}
+
+// publishes the observations computed since the last publish with a
+// pointer swap, does nothing if observations aren't double buffered;
+// the previously published buffer will be written to by the next step
+// or reset, so readers must be done with it by then
+void publishObs(env *e) {
+    if (e->publishedObs == NULL) {
+        return;
+    }
+    uint8_t *obs = e->obs;
+    e->obs = e->publishedObs;
+    e->publishedObs = obs;
+    e->publishedObsIdx ^= 1;
+}
+
+// publishes the last published observations again, for envs a batch
+// skips; every env of a batch has to publish so all of their
+// observations stay in the same buffer
+void republishObs(env *e) {
+    if (e->publishedObs == NULL) {
+        return;
     }
+    memcpy(e->obs, e->publishedObs, e->obsBytes * e->numAgents);
+    publishObs(e);
+}
+
+// returns the buffer holding the latest observations readers can see
+static inline uint8_t *latestObs(const env *e) {
+    if (e->publishedObs != NULL) {
+        return e->publishedObs;
+    }
+    return e->obs;
 }
 
 void setupEnv(env *e) {
@@ -554,6 +723,10 @@ void setupEnv(env *e) {
     }
 
     computeObs(e);
+
+    // allocations made while setting up aren't made while stepping, so
+    // don't count them towards the episode
+    e->episodeStartHeapAllocs = e->heapAllocs;
 }
 
 // sets the timing related variables for the environment depending on
@@ -578,10 +751,13 @@ env *initEnv(env *e, uint8_t numDrones, uint8_t numAgents, uint8_t *obs, bool di
     e->sittingDuck = sittingDuck;
     e->isTraining = isTraining;
 
+    e->obsFormat = OBS_FORMAT_FLOAT32;
     e->obsBytes = obsBytes(e->numDrones);
     e->discreteObsBytes = alignedSize(discreteObsSize(e->numDrones) * sizeof(uint8_t), sizeof(float));
 
     e->obs = obs;
+    e->publishedObs = NULL;
+    e->publishedObsIdx = 0;
     e->discretizeActions = discretizeActions;
     e->contActions = contActions;
     e->discActions = discActions;
@@ -609,27 +785,46 @@ env *initEnv(env *e, uint8_t numDrones, uint8_t numAgents, uint8_t *obs, bool di
     worldDef.gravity = (b2Vec2){.x = 0.0f, .y = 0.0f};
     e->worldID = b2CreateWorld(&worldDef);
     e->pinnedMapIdx = mapIdx;
+    e->pinnedDefaultWeapon = -1;
     e->mapIdx = -1;
 
-    cc_array_new(&e->cells);
-    cc_array_new(&e->walls);
-    cc_array_new(&e->floatingWalls);
+    e->cells = fastCalloc(MAX_CELLS, sizeof(mapCell));
+    e->numCells = 0;
+    e->obsCache.mapLayout = fastCalloc(MAX_CELLS, sizeof(uint8_t));
+    e->obsCache.floatingWallTransforms = fastCalloc(MAX_FLOATING_WALLS, sizeof(b2Transform));
+    e->walls = NULL;
+    e->mapWalls = fastCalloc(NUM_MAPS, sizeof(CC_Array *));
+    e->mergedWalls = NULL;
+    e->mapMergedWalls = fastCalloc(NUM_MAPS, sizeof(CC_Array *));
+    e->floatingWalls = createSlotMap(INITIAL_SLOT_MAP_CAPACITY, &e->heapAllocs);
     cc_array_new(&e->drones);
-    cc_array_new(&e->pickups);
-    cc_array_new(&e->projectiles);
+    e->pickups = createSlotMap(INITIAL_SLOT_MAP_CAPACITY, &e->heapAllocs);
+    e->projectiles = createSlotMap(INITIAL_SLOT_MAP_CAPACITY, &e->heapAllocs);
+    initProjectileColumns(&e->projectileCols, INITIAL_SLOT_MAP_CAPACITY);
+    memset(e->freeProjectileBodies, 0x0, sizeof(e->freeProjectileBodies));
+    memset(&e->releasedProjectileBodies, 0x0, sizeof(projectileBodyList));
+    memset(&e->coolingProjectileBodies, 0x0, sizeof(projectileBodyList));
     cc_array_new(&e->brakeTrailPoints);
     cc_array_new(&e->explosions);
     cc_array_new(&e->explodingProjectiles);
-    cc_array_new(&e->dronePieces);
-
-    e->mapPathing = fastCalloc(NUM_MAPS, sizeof(pathingInfo));
-    for (uint8_t i = 0; i < NUM_MAPS; i++) {
-        const mapEntry *map = maps[i];
-        pathingInfo *info = &e->mapPathing[i];
-        info->paths = fastMalloc(map->rows * map->columns * map->rows * map->columns * sizeof(uint8_t));
-        memset(info->paths, UINT8_MAX, map->rows * map->columns * map->rows * map->columns * sizeof(uint8_t));
-        info->pathBuffer = fastCalloc(3 * 8 * map->rows * map->columns, sizeof(int8_t));
-    }
+    e->dronePieces = createSlotMap(INITIAL_SLOT_MAP_CAPACITY, &e->heapAllocs);
+
+    e->heapAllocs = 0;
+    e->episodeStartHeapAllocs = 0;
+    memset(&e->stepTimes, 0x0, sizeof(stepTimings));
+    e->timedSteps = 0;
+    memset(&e->physicsTotals, 0x0, sizeof(physicsStats));
+    e->physicsSteps = 0;
+    initPool(&e->entityPool, sizeof(entity), POOL_BLOCK_ITEMS, &e->heapAllocs);
+    initPool(&e->wallPool, sizeof(wallEntity), POOL_BLOCK_ITEMS, &e->heapAllocs);
+    initPool(&e->pickupPool, sizeof(weaponPickupEntity), POOL_BLOCK_ITEMS, &e->heapAllocs);
+    initPool(&e->dronePool, sizeof(droneEntity), _MAX_DRONES, &e->heapAllocs);
+    initPool(&e->shieldPool, sizeof(shieldEntity), _MAX_DRONES, &e->heapAllocs);
+    initPool(&e->projectilePool, sizeof(projectileEntity), POOL_BLOCK_ITEMS, &e->heapAllocs);
+    initPool(&e->projectileTrailPool, sizeof(trailPoints), POOL_BLOCK_ITEMS, &e->heapAllocs);
+    initPool(&e->dronePiecePool, sizeof(dronePieceEntity), POOL_BLOCK_ITEMS, &e->heapAllocs);
+    initPool(&e->explosionPool, sizeof(explosionInfo), POOL_BLOCK_ITEMS, &e->heapAllocs);
+    initPool(&e->trailPointPool, sizeof(brakeTrailPoint), POOL_BLOCK_ITEMS, &e->heapAllocs);
 
     e->humanInput = false;
     e->humanDroneInput = 0;
@@ -647,81 +842,102 @@ void clearEnv(env *e) {
     e->episodeLength = 0;
     memset(e->stats, 0x0, sizeof(e->stats));
 
-    for (uint8_t i = 0; i < e->numDrones; i++) {
+    for (uint8_t i = 0; i < cc_array_size(e->drones); i++) {
         droneEntity *drone = safe_array_get_at(e->drones, i);
         destroyDrone(e, drone);
     }
 
-    for (size_t i = 0; i < cc_array_size(e->floatingWalls); i++) {
-        wallEntity *wall = safe_array_get_at(e->floatingWalls, i);
+    for (size_t i = 0; i < slotMapSize(e->floatingWalls); i++) {
+        wallEntity *wall = slotMapGetAt(e->floatingWalls, i);
         destroyWall(e, wall, false);
     }
 
-    for (size_t i = 0; i < cc_array_size(e->pickups); i++) {
-        weaponPickupEntity *pickup = safe_array_get_at(e->pickups, i);
+    for (size_t i = 0; i < slotMapSize(e->pickups); i++) {
+        weaponPickupEntity *pickup = slotMapGetAt(e->pickups, i);
         destroyWeaponPickup(e, pickup);
     }
 
-    for (size_t i = 0; i < cc_array_size(e->projectiles); i++) {
-        projectileEntity *p = safe_array_get_at(e->projectiles, i);
+    for (size_t i = 0; i < slotMapSize(e->projectiles); i++) {
+        projectileEntity *p = slotMapGetAt(e->projectiles, i);
         destroyProjectile(e, p, false, false);
     }
 
     for (size_t i = 0; i < cc_array_size(e->brakeTrailPoints); i++) {
         brakeTrailPoint *trailPoint = safe_array_get_at(e->brakeTrailPoints, i);
-        fastFree(trailPoint);
+        poolFree(&e->trailPointPool, trailPoint);
     }
 
     for (size_t i = 0; i < cc_array_size(e->explosions); i++) {
         explosionInfo *explosion = safe_array_get_at(e->explosions, i);
-        fastFree(explosion);
+        poolFree(&e->explosionPool, explosion);
     }
 
-    for (size_t i = 0; i < cc_array_size(e->dronePieces); i++) {
-        dronePieceEntity *piece = safe_array_get_at(e->dronePieces, i);
-        destroyDronePiece(piece);
+    for (size_t i = 0; i < slotMapSize(e->dronePieces); i++) {
+        dronePieceEntity *piece = slotMapGetAt(e->dronePieces, i);
+        destroyDronePiece(e, piece);
     }
 
     cc_array_remove_all(e->drones);
-    cc_array_remove_all(e->floatingWalls);
-    cc_array_remove_all(e->pickups);
-    cc_array_remove_all(e->projectiles);
+    slotMapClear(e->floatingWalls);
+    slotMapClear(e->pickups);
+    slotMapClear(e->projectiles);
     cc_array_remove_all(e->explodingProjectiles);
     cc_array_remove_all(e->brakeTrailPoints);
     cc_array_remove_all(e->explosions);
-    cc_array_remove_all(e->dronePieces);
+    slotMapClear(e->dronePieces);
 }
 
 void destroyEnv(env *e) {
     clearEnv(e);
 
     for (uint8_t i = 0; i < NUM_MAPS; i++) {
-        pathingInfo *info = &e->mapPathing[i];
-        fastFree(info->paths);
-        fastFree(info->pathBuffer);
-    }
-    fastFree(e->mapPathing);
-
-    for (size_t i = 0; i < cc_array_size(e->walls); i++) {
-        wallEntity *wall = safe_array_get_at(e->walls, i);
-        destroyWall(e, wall, false);
-    }
+        if (e->mapWalls[i] == NULL) {
+            continue;
+        }
+        for (size_t j = 0; j < cc_array_size(e->mapWalls[i]); j++) {
+            wallEntity *wall = safe_array_get_at(e->mapWalls[i], j);
+            destroyWall(e, wall, false);
+        }
+        cc_array_destroy(e->mapWalls[i]);
 
-    for (size_t i = 0; i < cc_array_size(e->cells); i++) {
-        mapCell *cell = safe_array_get_at(e->cells, i);
-        fastFree(cell);
+        for (size_t j = 0; j < cc_array_size(e->mapMergedWalls[i]); j++) {
+            wallEntity *wall = safe_array_get_at(e->mapMergedWalls[i], j);
+            destroyWall(e, wall, false);
+        }
+        cc_array_destroy(e->mapMergedWalls[i]);
     }
+    fastFree(e->mapWalls);
+    fastFree(e->mapMergedWalls);
 
-    cc_array_destroy(e->cells);
-    cc_array_destroy(e->walls);
+    fastFree(e->cells);
+    fastFree(e->obsCache.mapLayout);
+    fastFree(e->obsCache.floatingWallTransforms);
     cc_array_destroy(e->drones);
-    cc_array_destroy(e->floatingWalls);
-    cc_array_destroy(e->pickups);
-    cc_array_destroy(e->projectiles);
+    destroySlotMap(e->floatingWalls);
+    destroySlotMap(e->pickups);
+    destroySlotMap(e->projectiles);
+    destroyProjectileColumns(&e->projectileCols);
+    // the bodies themselves are destroyed with the world
+    for (uint8_t i = 0; i < NUM_WEAPONS; i++) {
+        fastFree(e->freeProjectileBodies[i].bodies);
+    }
+    fastFree(e->releasedProjectileBodies.bodies);
+    fastFree(e->coolingProjectileBodies.bodies);
     cc_array_destroy(e->brakeTrailPoints);
     cc_array_destroy(e->explosions);
     cc_array_destroy(e->explodingProjectiles);
-    cc_array_destroy(e->dronePieces);
+    destroySlotMap(e->dronePieces);
+
+    destroyPool(&e->entityPool);
+    destroyPool(&e->wallPool);
+    destroyPool(&e->pickupPool);
+    destroyPool(&e->dronePool);
+    destroyPool(&e->shieldPool);
+    destroyPool(&e->projectilePool);
+    destroyPool(&e->projectileTrailPool);
+    destroyPool(&e->dronePiecePool);
+    destroyPool(&e->explosionPool);
+    destroyPool(&e->trailPointPool);
 
     b2DestroyWorld(e->worldID);
 }
@@ -1038,10 +1254,91 @@ bool droneControlledByHuman(const env *e, uint8_t i) {
     return (e->connectedControllers > 1 && i >= e->humanDroneInput) || (e->connectedControllers <= 1 && i == e->humanDroneInput);
 }
 
+#ifdef STEP_TIMERS
+// records the average time spent per step in each phase since the last
+// episode was logged, and starts measuring from scratch
+void logStepTimes(env *e, logEntry *log) {
+    const double steps = max(e->timedSteps, 1u);
+    log->stepTimes.actions = e->stepTimes.actions / steps;
+    log->stepTimes.physics = e->stepTimes.physics / steps;
+    log->stepTimes.bodyMoveEvents = e->stepTimes.bodyMoveEvents / steps;
+    log->stepTimes.contactEvents = e->stepTimes.contactEvents / steps;
+    log->stepTimes.sensorEvents = e->stepTimes.sensorEvents / steps;
+    log->stepTimes.projectiles = e->stepTimes.projectiles / steps;
+    log->stepTimes.drones = e->stepTimes.drones / steps;
+    log->stepTimes.pickups = e->stepTimes.pickups / steps;
+    log->stepTimes.rewards = e->stepTimes.rewards / steps;
+    log->stepTimes.obs = e->stepTimes.obs / steps;
+    log->stepTimes.reset = e->stepTimes.reset / steps;
+
+    memset(&e->stepTimes, 0x0, sizeof(stepTimings));
+    e->timedSteps = 0;
+}
+#endif
+
+#ifdef PHYSICS_STATS
+// adds box2d's stats of the last physics step to the env's totals
+void addPhysicsStats(env *e) {
+    const b2Profile profile = b2World_GetProfile(e->worldID);
+    const b2Counters counters = b2World_GetCounters(e->worldID);
+
+    physicsStats *totals = &e->physicsTotals;
+    totals->step += profile.step;
+    totals->pairs += profile.pairs;
+    totals->refit += profile.refit;
+    totals->collide += profile.collide;
+    totals->solve += profile.solve;
+    totals->solveConstraints += profile.solveConstraints;
+    totals->continuous += profile.bullets;
+    totals->splitIslands += profile.splitIslands;
+    totals->sleepIslands += profile.sleepIslands;
+    totals->bodies += counters.bodyCount;
+    totals->shapes += counters.shapeCount;
+    totals->contacts += counters.contactCount;
+    totals->joints += counters.jointCount;
+    totals->islands += counters.islandCount;
+    totals->treeHeight += counters.treeHeight;
+    totals->staticTreeHeight += counters.staticTreeHeight;
+    e->physicsSteps++;
+}
+
+// records box2d's stats averaged per physics step since the last episode
+// was logged, and starts accumulating from scratch
+void logPhysicsStats(env *e, logEntry *log) {
+    const float steps = max(e->physicsSteps, 1u);
+    const physicsStats *totals = &e->physicsTotals;
+    log->physics.step = totals->step / steps;
+    log->physics.pairs = totals->pairs / steps;
+    log->physics.refit = totals->refit / steps;
+    log->physics.collide = totals->collide / steps;
+    log->physics.solve = totals->solve / steps;
+    log->physics.solveConstraints = totals->solveConstraints / steps;
+    log->physics.continuous = totals->continuous / steps;
+    log->physics.splitIslands = totals->splitIslands / steps;
+    log->physics.sleepIslands = totals->sleepIslands / steps;
+    log->physics.bodies = totals->bodies / steps;
+    log->physics.shapes = totals->shapes / steps;
+    log->physics.contacts = totals->contacts / steps;
+    log->physics.joints = totals->joints / steps;
+    log->physics.islands = totals->islands / steps;
+    log->physics.treeHeight = totals->treeHeight / steps;
+    log->physics.staticTreeHeight = totals->staticTreeHeight / steps;
+
+    memset(&e->physicsTotals, 0x0, sizeof(physicsStats));
+    e->physicsSteps = 0;
+}
+#endif
+
 void stepEnv(env *e) {
+#ifdef STEP_TIMERS
+    e->timedSteps++;
+#endif
+
     if (e->needsReset) {
         DEBUG_LOG("Resetting environment");
+        STEP_TIMER_START(reset);
         resetEnv(e);
+        STEP_TIMER_END(e, reset);
 
 #ifdef __EMSCRIPTEN__
         lastFrameTime = emscripten_get_now();
@@ -1053,6 +1350,7 @@ void stepEnv(env *e) {
     memset(stepActions, 0x0, e->numDrones * sizeof(agentActions));
 
     // preprocess agent actions for the next frameSkip steps
+    STEP_TIMER_START(actions);
     for (uint8_t i = 0; i < e->numDrones; i++) {
         droneEntity *drone = safe_array_get_at(e->drones, i);
         if (drone->dead || droneControlledByHuman(e, i)) {
@@ -1066,6 +1364,7 @@ void stepEnv(env *e) {
             stepActions[i] = computeActions(e, drone, &scriptedActions);
         }
     }
+    STEP_TIMER_END(e, actions);
 
     // reset reward buffer
     memset(e->rewards, 0x0, e->numAgents * sizeof(float));
@@ -1136,14 +1435,26 @@ void stepEnv(env *e) {
                 }
             }
 
+            STEP_TIMER_START(physics);
             b2World_Step(e->worldID, e->deltaTime, e->box2dSubSteps);
+            STEP_TIMER_END(e, physics);
+#ifdef PHYSICS_STATS
+            addPhysicsStats(e);
+#endif
 
             // update dynamic body positions and velocities
+            STEP_TIMER_START(bodyMoveEvents);
             handleBodyMoveEvents(e);
+            STEP_TIMER_END(e, bodyMoveEvents);
 
             // handle collisions
+            STEP_TIMER_START(contactEvents);
             handleContactEvents(e);
+            STEP_TIMER_END(e, contactEvents);
+            STEP_TIMER_START(sensorEvents);
             handleSensorEvents(e);
+            STEP_TIMER_END(e, sensorEvents);
+            recycleProjectileBodies(e);
 
             // handle sudden death
             e->stepsLeft = max(e->stepsLeft - 1, 0);
@@ -1156,8 +1467,11 @@ void stepEnv(env *e) {
                 }
             }
 
+            STEP_TIMER_START(projectiles);
             projectilesStep(e);
+            STEP_TIMER_END(e, projectiles);
 
+            STEP_TIMER_START(drones);
             int8_t lastAlive = -1;
             int8_t lastAliveTeam = -1;
             bool allAliveOnSameTeam = false;
@@ -1193,7 +1507,11 @@ void stepEnv(env *e) {
                 }
             }
 
+            STEP_TIMER_END(e, drones);
+
+            STEP_TIMER_START(pickups);
             weaponPickupsStep(e);
+            STEP_TIMER_END(e, pickups);
 
             if (!roundOver) {
                 roundOver = deadDrones >= e->numDrones - 1;
@@ -1211,7 +1529,9 @@ void stepEnv(env *e) {
             if (roundOver && deadDrones < e->numDrones - 1) {
                 lastAlive = -1;
             }
+            STEP_TIMER_START(rewards);
             computeRewards(e, roundOver, lastAlive, lastAliveTeam);
+            STEP_TIMER_END(e, rewards);
 
             if (e->client != NULL) {
                 renderEnv(e, false, roundOver, lastAlive, lastAliveTeam);
@@ -1228,6 +1548,13 @@ void stepEnv(env *e) {
 
                 logEntry log = {0};
                 log.length = e->episodeLength;
+                log.heapAllocs = e->heapAllocs - e->episodeStartHeapAllocs;
+#ifdef STEP_TIMERS
+                logStepTimes(e, &log);
+#endif
+#ifdef PHYSICS_STATS
+                logPhysicsStats(e, &log);
+#endif
                 if (lastAlive != -1) {
                     e->stats[lastAlive].wins = 1.0f;
                 } else if (!e->teamsEnabled || (e->teamsEnabled && lastAliveTeam == -1)) {
@@ -1280,7 +1607,9 @@ void stepEnv(env *e) {
     }
 #endif
 
+    STEP_TIMER_START(obs);
     computeObs(e);
+    STEP_TIMER_END(e, obs);
 }
 
 #endif
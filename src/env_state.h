@@ -0,0 +1,1108 @@
+#ifndef IMPULSE_WARS_ENV_STATE_H
+#define IMPULSE_WARS_ENV_STATE_H
+
+#include "env.h"
+
+// saving and restoring the full state of an env so search based agents
+// can roll out from a state many times; a state is a flat buffer of the
+// fields restoring needs, written one at a time so the format doesn't
+// depend on how entity structs are laid out. Pointers and box2d ids
+// aren't meaningful outside of the env they were saved from so they're
+// recreated on restore, and anything only used for rendering is dropped
+//
+// box2d can't save its contact and warm starting caches, so contacts and
+// sensor overlaps are rebuilt on the first step after a restore; physics
+// after a restore is equivalent but not bit for bit identical to the
+// original env
+
+// must be incremented whenever a field is added, removed or reordered
+// in any of the serialize functions below
+const uint32_t ENV_STATE_VERSION = 3;
+
+// returned by restoreEnvState, the env is unchanged if the state isn't
+// restored
+enum envStateStatus {
+    ENV_STATE_OK,
+    ENV_STATE_VERSION_MISMATCH,
+    ENV_STATE_SIZE_MISMATCH,
+    ENV_STATE_ENV_MISMATCH,
+    ENV_STATE_INVALID,
+};
+
+const char *envStateStatusMessage(const enum envStateStatus status) {
+    switch (status) {
+    case ENV_STATE_OK:
+        return "ok";
+    case ENV_STATE_VERSION_MISMATCH:
+        return "env state version doesn't match";
+    case ENV_STATE_SIZE_MISMATCH:
+        return "env state is truncated or has trailing data";
+    case ENV_STATE_ENV_MISMATCH:
+        return "env state was saved from an env with a different number of drones, agents or observations";
+    case ENV_STATE_INVALID:
+        return "env state is corrupt";
+    default:
+        return "unknown env state status";
+    }
+}
+
+typedef struct envState {
+    uint8_t *data;
+    uint32_t size;
+    uint32_t capacity;
+} envState;
+
+// the records below only exist while saving or restoring, the order
+// their fields are serialized in is what defines the format
+
+typedef struct savedEnvHeader {
+    // version and size must stay the first two fields
+    uint32_t version;
+    uint32_t size;
+    uint8_t numDrones;
+    uint8_t numAgents;
+    uint16_t obsBytes;
+
+    int8_t mapIdx;
+    uint8_t defaultWeapon;
+    int8_t lastSpawnQuad;
+    uint64_t randState;
+    bool needsReset;
+    uint16_t episodeLength;
+    droneStats stats[_MAX_DRONES];
+    uint16_t stepsLeft;
+    uint16_t suddenDeathSteps;
+    uint8_t suddenDeathWallCounter;
+    bool suddenDeathWallsPlaced;
+    uint8_t spawnedWeaponPickups[_NUM_WEAPONS];
+
+    uint16_t numSuddenDeathWalls;
+    uint16_t numFloatingWalls;
+    uint16_t numPickups;
+    uint16_t numProjectiles;
+    uint16_t numPieces;
+} savedEnvHeader;
+
+typedef struct savedBody {
+    b2Vec2 pos;
+    b2Rot rot;
+    b2Vec2 linearVelocity;
+    float angularVelocity;
+    bool enabled;
+    bool awake;
+} savedBody;
+
+// sudden death walls always fill a single cell, so only their cell
+// index is saved
+typedef struct savedFloatingWall {
+    uint8_t type;
+    int16_t mapCellIdx;
+    b2Vec2 pos;
+    b2Rot rot;
+    b2Vec2 velocity;
+    b2Vec2 extent;
+    savedBody body;
+} savedFloatingWall;
+
+typedef struct savedPickup {
+    uint8_t weapon;
+    float respawnWait;
+    b2Vec2 pos;
+    int16_t mapCellIdx;
+    bool bodyDestroyed;
+} savedPickup;
+
+typedef struct savedShield {
+    b2Vec2 pos;
+    float health;
+    float duration;
+    savedBody body;
+} savedShield;
+
+// per step info isn't saved, it's cleared at the start of every step
+typedef struct savedDrone {
+    uint8_t idx;
+    uint8_t team;
+    uint8_t weapon;
+    int8_t ammo;
+    float weaponCooldown;
+    uint16_t heat;
+    bool chargingWeapon;
+    float weaponCharge;
+    float energyLeft;
+    bool braking;
+    bool chargingBurst;
+    float burstCharge;
+    float burstCooldown;
+    bool energyFullyDepleted;
+    bool energyFullyDepletedThisStep;
+    float energyRefillWait;
+    bool shotThisStep;
+    bool diedThisStep;
+
+    b2Vec2 initalPos;
+    b2Vec2 pos;
+    int16_t mapCellIdx;
+    b2Vec2 lastPos;
+    b2Vec2 lastMove;
+    b2Vec2 lastAim;
+    b2Vec2 velocity;
+    b2Vec2 lastVelocity;
+    float respawnWait;
+    uint8_t livesLeft;
+    bool dead;
+
+    savedBody body;
+    bool hasShield;
+    savedShield shield;
+} savedDrone;
+
+// a weld joint sticking a mine to a wall; the wall is referenced by its
+// index in env.walls, env.mergedWalls or env.floatingWalls
+typedef struct savedWeld {
+    bool welded;
+    bool floatingWall;
+    bool mergedWall;
+    uint16_t wallIdx;
+    bool projectileIsBodyA;
+    b2Vec2 localAnchorA;
+    b2Vec2 localAnchorB;
+    float referenceAngle;
+} savedWeld;
+
+typedef struct savedProjectile {
+    uint8_t droneIdx;
+    uint8_t weapon;
+    b2Vec2 pos;
+    int16_t mapCellIdx;
+    b2Vec2 lastPos;
+    float distance;
+    b2Vec2 velocity;
+    b2Vec2 lastVelocity;
+    float speed;
+    float lastSpeed;
+    uint8_t bounces;
+    bool setMine;
+    bool needsToBeDestroyed;
+    uint8_t numDronesBehindWalls;
+    uint8_t dronesBehindWalls[_MAX_DRONES];
+    savedBody body;
+    savedWeld weld;
+} savedProjectile;
+
+typedef struct savedPiece {
+    uint8_t droneIdx;
+    b2Vec2 pos;
+    b2Rot rot;
+    b2Vec2 vertices[3];
+    bool isShieldPiece;
+    uint16_t lifetime;
+    savedBody body;
+} savedPiece;
+
+envState *createEnvState() {
+    envState *s = fastCalloc(1, sizeof(envState));
+    return s;
+}
+
+void destroyEnvState(envState *s) {
+    fastFree(s->data);
+    fastFree(s);
+}
+
+static void *envStateReserve(envState *s, const uint32_t size) {
+    if (s->size + size > s->capacity) {
+        s->capacity = max(s->capacity * 2, s->size + size);
+        s->data = fastRealloc(s->data, s->capacity);
+        if (s->data == NULL) {
+            ERROR("failed to grow env state buffer");
+        }
+    }
+    void *record = s->data + s->size;
+    s->size += size;
+    return record;
+}
+
+// serializes fields of a state in order; dst is set when saving and src
+// when restoring, so the same serialize functions both write and read
+// a record and can't disagree about the format
+typedef struct envStateCursor {
+    envState *dst;
+    const envState *src;
+    uint32_t offset;
+    // set if a read would go past the end of the state, reads after
+    // that zero their fields
+    bool overrun;
+} envStateCursor;
+
+static inline void envStateField(envStateCursor *c, void *field, const uint32_t size) {
+    if (c->dst != NULL) {
+        memcpy(envStateReserve(c->dst, size), field, size);
+        return;
+    }
+    if (c->overrun || size > c->src->size - c->offset) {
+        c->overrun = true;
+        memset(field, 0x0, size);
+        return;
+    }
+    memcpy(field, c->src->data + c->offset, size);
+    c->offset += size;
+}
+
+#define STATE_FIELD(c, field) envStateField(c, &(field), sizeof(field))
+
+static inline void envStateSkip(envStateCursor *c, const uint32_t size) {
+    ASSERT(c->src != NULL);
+    if (c->overrun || size > c->src->size - c->offset) {
+        c->overrun = true;
+        return;
+    }
+    c->offset += size;
+}
+
+static void serializeDroneStats(envStateCursor *c, droneStats *stats) {
+    STATE_FIELD(c, stats->reward);
+    STATE_FIELD(c, stats->distanceTraveled);
+    STATE_FIELD(c, stats->absDistanceTraveled);
+    STATE_FIELD(c, stats->shotsFired);
+    STATE_FIELD(c, stats->shotsHit);
+    STATE_FIELD(c, stats->shotsTaken);
+    STATE_FIELD(c, stats->ownShotsTaken);
+    STATE_FIELD(c, stats->weaponsPickedUp);
+    STATE_FIELD(c, stats->shotDistances);
+    STATE_FIELD(c, stats->brakeTime);
+    STATE_FIELD(c, stats->totalBursts);
+    STATE_FIELD(c, stats->burstsHit);
+    STATE_FIELD(c, stats->energyEmptied);
+    STATE_FIELD(c, stats->wins);
+}
+
+static void serializeHeader(envStateCursor *c, savedEnvHeader *header) {
+    STATE_FIELD(c, header->version);
+    STATE_FIELD(c, header->size);
+    STATE_FIELD(c, header->numDrones);
+    STATE_FIELD(c, header->numAgents);
+    STATE_FIELD(c, header->obsBytes);
+
+    STATE_FIELD(c, header->mapIdx);
+    STATE_FIELD(c, header->defaultWeapon);
+    STATE_FIELD(c, header->lastSpawnQuad);
+    STATE_FIELD(c, header->randState);
+    STATE_FIELD(c, header->needsReset);
+    STATE_FIELD(c, header->episodeLength);
+    // only the stats of drones in the env are saved
+    for (uint8_t i = 0; i < min(header->numDrones, _MAX_DRONES); i++) {
+        serializeDroneStats(c, &header->stats[i]);
+    }
+    STATE_FIELD(c, header->stepsLeft);
+    STATE_FIELD(c, header->suddenDeathSteps);
+    STATE_FIELD(c, header->suddenDeathWallCounter);
+    STATE_FIELD(c, header->suddenDeathWallsPlaced);
+    STATE_FIELD(c, header->spawnedWeaponPickups);
+
+    STATE_FIELD(c, header->numSuddenDeathWalls);
+    STATE_FIELD(c, header->numFloatingWalls);
+    STATE_FIELD(c, header->numPickups);
+    STATE_FIELD(c, header->numProjectiles);
+    STATE_FIELD(c, header->numPieces);
+}
+
+static void serializeBody(envStateCursor *c, savedBody *body) {
+    STATE_FIELD(c, body->pos);
+    STATE_FIELD(c, body->rot);
+    STATE_FIELD(c, body->linearVelocity);
+    STATE_FIELD(c, body->angularVelocity);
+    STATE_FIELD(c, body->enabled);
+    STATE_FIELD(c, body->awake);
+}
+
+static void serializeFloatingWall(envStateCursor *c, savedFloatingWall *wall) {
+    STATE_FIELD(c, wall->type);
+    STATE_FIELD(c, wall->mapCellIdx);
+    STATE_FIELD(c, wall->pos);
+    STATE_FIELD(c, wall->rot);
+    STATE_FIELD(c, wall->velocity);
+    STATE_FIELD(c, wall->extent);
+    serializeBody(c, &wall->body);
+}
+
+static void serializePickup(envStateCursor *c, savedPickup *pickup) {
+    STATE_FIELD(c, pickup->weapon);
+    STATE_FIELD(c, pickup->respawnWait);
+    STATE_FIELD(c, pickup->pos);
+    STATE_FIELD(c, pickup->mapCellIdx);
+    STATE_FIELD(c, pickup->bodyDestroyed);
+}
+
+static void serializeDrone(envStateCursor *c, savedDrone *drone) {
+    STATE_FIELD(c, drone->idx);
+    STATE_FIELD(c, drone->team);
+    STATE_FIELD(c, drone->weapon);
+    STATE_FIELD(c, drone->ammo);
+    STATE_FIELD(c, drone->weaponCooldown);
+    STATE_FIELD(c, drone->heat);
+    STATE_FIELD(c, drone->chargingWeapon);
+    STATE_FIELD(c, drone->weaponCharge);
+    STATE_FIELD(c, drone->energyLeft);
+    STATE_FIELD(c, drone->braking);
+    STATE_FIELD(c, drone->chargingBurst);
+    STATE_FIELD(c, drone->burstCharge);
+    STATE_FIELD(c, drone->burstCooldown);
+    STATE_FIELD(c, drone->energyFullyDepleted);
+    STATE_FIELD(c, drone->energyFullyDepletedThisStep);
+    STATE_FIELD(c, drone->energyRefillWait);
+    STATE_FIELD(c, drone->shotThisStep);
+    STATE_FIELD(c, drone->diedThisStep);
+
+    STATE_FIELD(c, drone->initalPos);
+    STATE_FIELD(c, drone->pos);
+    STATE_FIELD(c, drone->mapCellIdx);
+    STATE_FIELD(c, drone->lastPos);
+    STATE_FIELD(c, drone->lastMove);
+    STATE_FIELD(c, drone->lastAim);
+    STATE_FIELD(c, drone->velocity);
+    STATE_FIELD(c, drone->lastVelocity);
+    STATE_FIELD(c, drone->respawnWait);
+    STATE_FIELD(c, drone->livesLeft);
+    STATE_FIELD(c, drone->dead);
+
+    serializeBody(c, &drone->body);
+    STATE_FIELD(c, drone->hasShield);
+    if (drone->hasShield) {
+        STATE_FIELD(c, drone->shield.pos);
+        STATE_FIELD(c, drone->shield.health);
+        STATE_FIELD(c, drone->shield.duration);
+        serializeBody(c, &drone->shield.body);
+    }
+}
+
+static void serializeWeld(envStateCursor *c, savedWeld *weld) {
+    STATE_FIELD(c, weld->welded);
+    if (!weld->welded) {
+        return;
+    }
+    STATE_FIELD(c, weld->floatingWall);
+    STATE_FIELD(c, weld->mergedWall);
+    STATE_FIELD(c, weld->wallIdx);
+    STATE_FIELD(c, weld->projectileIsBodyA);
+    STATE_FIELD(c, weld->localAnchorA);
+    STATE_FIELD(c, weld->localAnchorB);
+    STATE_FIELD(c, weld->referenceAngle);
+}
+
+static void serializeProjectile(envStateCursor *c, savedProjectile *projectile) {
+    STATE_FIELD(c, projectile->droneIdx);
+    STATE_FIELD(c, projectile->weapon);
+    STATE_FIELD(c, projectile->pos);
+    STATE_FIELD(c, projectile->mapCellIdx);
+    STATE_FIELD(c, projectile->lastPos);
+    STATE_FIELD(c, projectile->distance);
+    STATE_FIELD(c, projectile->velocity);
+    STATE_FIELD(c, projectile->lastVelocity);
+    STATE_FIELD(c, projectile->speed);
+    STATE_FIELD(c, projectile->lastSpeed);
+    STATE_FIELD(c, projectile->bounces);
+    STATE_FIELD(c, projectile->setMine);
+    STATE_FIELD(c, projectile->needsToBeDestroyed);
+    STATE_FIELD(c, projectile->numDronesBehindWalls);
+    for (uint8_t i = 0; i < min(projectile->numDronesBehindWalls, _MAX_DRONES); i++) {
+        STATE_FIELD(c, projectile->dronesBehindWalls[i]);
+    }
+    serializeBody(c, &projectile->body);
+    serializeWeld(c, &projectile->weld);
+}
+
+static void serializePiece(envStateCursor *c, savedPiece *piece) {
+    STATE_FIELD(c, piece->droneIdx);
+    STATE_FIELD(c, piece->pos);
+    STATE_FIELD(c, piece->rot);
+    STATE_FIELD(c, piece->vertices);
+    STATE_FIELD(c, piece->isShieldPiece);
+    STATE_FIELD(c, piece->lifetime);
+    serializeBody(c, &piece->body);
+}
+
+static savedBody saveBody(const b2BodyId bodyID) {
+    const bool enabled = b2Body_IsEnabled(bodyID);
+    return (savedBody){
+        .pos = b2Body_GetPosition(bodyID),
+        .rot = b2Body_GetRotation(bodyID),
+        .linearVelocity = b2Body_GetLinearVelocity(bodyID),
+        .angularVelocity = b2Body_GetAngularVelocity(bodyID),
+        .enabled = enabled,
+        .awake = enabled && b2Body_IsAwake(bodyID),
+    };
+}
+
+static void restoreBody(const b2BodyId bodyID, const savedBody *body) {
+    if (!body->enabled) {
+        b2Body_SetTransform(bodyID, body->pos, body->rot);
+        b2Body_Disable(bodyID);
+        return;
+    }
+    if (!b2Body_IsEnabled(bodyID)) {
+        b2Body_Enable(bodyID);
+    }
+    b2Body_SetTransform(bodyID, body->pos, body->rot);
+    b2Body_SetLinearVelocity(bodyID, body->linearVelocity);
+    b2Body_SetAngularVelocity(bodyID, body->angularVelocity);
+    // setting a velocity wakes the body, so do this last
+    b2Body_SetAwake(bodyID, body->awake);
+}
+
+static uint16_t wallStateIdx(const env *e, const wallEntity *wall) {
+    if (wall->isFloating) {
+        for (uint16_t i = 0; i < slotMapSize(e->floatingWalls); i++) {
+            if (slotMapGetAt(e->floatingWalls, i) == wall) {
+                return i;
+            }
+        }
+    } else if (wall->mergedColumns != 0) {
+        for (uint16_t i = 0; i < cc_array_size(e->mergedWalls); i++) {
+            if (safe_array_get_at(e->mergedWalls, i) == wall) {
+                return i;
+            }
+        }
+    } else {
+        for (uint16_t i = 0; i < cc_array_size(e->walls); i++) {
+            if (safe_array_get_at(e->walls, i) == wall) {
+                return i;
+            }
+        }
+    }
+    ERROR("welded wall not found");
+}
+
+static savedWeld saveWeld(const env *e, const projectileEntity *projectile) {
+    savedWeld weld = {0};
+    const int numJoints = b2Body_GetJointCount(projectile->bodyID);
+    if (numJoints == 0) {
+        return weld;
+    }
+    ASSERTF(numJoints == 1, "joints: %d", numJoints);
+
+    b2JointId jointID;
+    b2Body_GetJoints(projectile->bodyID, &jointID, 1);
+    const b2BodyId bodyA = b2Joint_GetBodyA(jointID);
+    const b2BodyId bodyB = b2Joint_GetBodyB(jointID);
+    weld.projectileIsBodyA = B2_ID_EQUALS(bodyA, projectile->bodyID);
+    b2BodyId wallBodyID = bodyA;
+    if (weld.projectileIsBodyA) {
+        wallBodyID = bodyB;
+    }
+    const entity *ent = b2Body_GetUserData(wallBodyID);
+    ASSERT(ent != NULL && entityTypeIsWall(ent->type));
+    const wallEntity *wall = ent->entity;
+
+    weld.welded = true;
+    weld.floatingWall = wall->isFloating;
+    weld.mergedWall = wall->mergedColumns != 0;
+    weld.wallIdx = wallStateIdx(e, wall);
+    weld.localAnchorA = b2Joint_GetLocalAnchorA(jointID);
+    weld.localAnchorB = b2Joint_GetLocalAnchorB(jointID);
+    weld.referenceAngle = b2WeldJoint_GetReferenceAngle(jointID);
+    return weld;
+}
+
+static void restoreWeld(env *e, const projectileEntity *projectile, const savedWeld *weld) {
+    if (!weld->welded) {
+        return;
+    }
+
+    const wallEntity *wall;
+    if (weld->floatingWall) {
+        wall = slotMapGetAt(e->floatingWalls, weld->wallIdx);
+    } else if (weld->mergedWall) {
+        wall = safe_array_get_at(e->mergedWalls, weld->wallIdx);
+    } else {
+        wall = safe_array_get_at(e->walls, weld->wallIdx);
+    }
+
+    b2WeldJointDef jointDef = b2DefaultWeldJointDef();
+    jointDef.bodyIdA = wall->bodyID;
+    jointDef.bodyIdB = projectile->bodyID;
+    if (weld->projectileIsBodyA) {
+        jointDef.bodyIdA = projectile->bodyID;
+        jointDef.bodyIdB = wall->bodyID;
+    }
+    jointDef.localAnchorA = weld->localAnchorA;
+    jointDef.localAnchorB = weld->localAnchorB;
+    jointDef.referenceAngle = weld->referenceAngle;
+    b2CreateWeldJoint(e->worldID, &jointDef);
+}
+
+static savedFloatingWall saveFloatingWall(const wallEntity *wall) {
+    return (savedFloatingWall){
+        .type = wall->type,
+        .mapCellIdx = wall->mapCellIdx,
+        .pos = wall->pos,
+        .rot = wall->rot,
+        .velocity = wall->velocity,
+        .extent = wall->extent,
+        .body = saveBody(wall->bodyID),
+    };
+}
+
+static savedPickup savePickup(const weaponPickupEntity *pickup) {
+    return (savedPickup){
+        .weapon = pickup->weapon,
+        .respawnWait = pickup->respawnWait,
+        .pos = pickup->pos,
+        .mapCellIdx = pickup->mapCellIdx,
+        .bodyDestroyed = pickup->bodyDestroyed,
+    };
+}
+
+static savedDrone saveDrone(const droneEntity *drone) {
+    savedDrone saved = {
+        .idx = drone->idx,
+        .team = drone->team,
+        .weapon = drone->weaponInfo->type,
+        .ammo = drone->ammo,
+        .weaponCooldown = drone->weaponCooldown,
+        .heat = drone->heat,
+        .chargingWeapon = drone->chargingWeapon,
+        .weaponCharge = drone->weaponCharge,
+        .energyLeft = drone->energyLeft,
+        .braking = drone->braking,
+        .chargingBurst = drone->chargingBurst,
+        .burstCharge = drone->burstCharge,
+        .burstCooldown = drone->burstCooldown,
+        .energyFullyDepleted = drone->energyFullyDepleted,
+        .energyFullyDepletedThisStep = drone->energyFullyDepletedThisStep,
+        .energyRefillWait = drone->energyRefillWait,
+        .shotThisStep = drone->shotThisStep,
+        .diedThisStep = drone->diedThisStep,
+
+        .initalPos = drone->initalPos,
+        .pos = drone->pos,
+        .mapCellIdx = drone->mapCellIdx,
+        .lastPos = drone->lastPos,
+        .lastMove = drone->lastMove,
+        .lastAim = drone->lastAim,
+        .velocity = drone->velocity,
+        .lastVelocity = drone->lastVelocity,
+        .respawnWait = drone->respawnWait,
+        .livesLeft = drone->livesLeft,
+        .dead = drone->dead,
+
+        .body = saveBody(drone->bodyID),
+        .hasShield = drone->shield != NULL,
+    };
+    if (saved.hasShield) {
+        saved.shield = (savedShield){
+            .pos = drone->shield->pos,
+            .health = drone->shield->health,
+            .duration = drone->shield->duration,
+            .body = saveBody(drone->shield->bodyID),
+        };
+    }
+    return saved;
+}
+
+static savedProjectile saveProjectile(const env *e, const projectileEntity *projectile) {
+    const uint16_t col = projectileCol(projectile);
+    savedProjectile saved = {
+        .droneIdx = projectile->droneIdx,
+        .weapon = projectile->weaponInfo->type,
+        .pos = projectile->pos,
+        .mapCellIdx = projectile->mapCellIdx,
+        .lastPos = {.x = e->projectileCols.lastPosX[col], .y = e->projectileCols.lastPosY[col]},
+        .distance = e->projectileCols.distance[col],
+        .velocity = projectile->velocity,
+        .lastVelocity = projectile->lastVelocity,
+        .speed = projectile->speed,
+        .lastSpeed = projectile->lastSpeed,
+        .bounces = projectile->bounces,
+        .setMine = projectile->setMine,
+        .needsToBeDestroyed = projectile->needsToBeDestroyed,
+        .numDronesBehindWalls = projectile->numDronesBehindWalls,
+        .body = saveBody(projectile->bodyID),
+        .weld = saveWeld(e, projectile),
+    };
+    memcpy(saved.dronesBehindWalls, projectile->dronesBehindWalls, sizeof(saved.dronesBehindWalls));
+    return saved;
+}
+
+static savedPiece savePiece(const dronePieceEntity *piece) {
+    savedPiece saved = {
+        .droneIdx = piece->droneIdx,
+        .pos = piece->pos,
+        .rot = piece->rot,
+        .isShieldPiece = piece->isShieldPiece,
+        .lifetime = piece->lifetime,
+        .body = saveBody(piece->bodyID),
+    };
+    memcpy(saved.vertices, piece->vertices, sizeof(saved.vertices));
+    return saved;
+}
+
+// saves the state of e into s, overwriting anything s held; envs are
+// only saved between steps
+void saveEnvState(const env *e, envState *s) {
+    ASSERT(cc_array_size(e->explodingProjectiles) == 0);
+    s->size = 0;
+    envStateCursor c = {.dst = s};
+
+    savedEnvHeader header = {
+        .version = ENV_STATE_VERSION,
+        .numDrones = e->numDrones,
+        .numAgents = e->numAgents,
+        .obsBytes = e->obsBytes,
+        .mapIdx = e->mapIdx,
+        .defaultWeapon = e->defaultWeapon->type,
+        .lastSpawnQuad = e->lastSpawnQuad,
+        .randState = e->randState,
+        .needsReset = e->needsReset,
+        .episodeLength = e->episodeLength,
+        .stepsLeft = e->stepsLeft,
+        .suddenDeathSteps = e->suddenDeathSteps,
+        .suddenDeathWallCounter = e->suddenDeathWallCounter,
+        .suddenDeathWallsPlaced = e->suddenDeathWallsPlaced,
+        .numFloatingWalls = slotMapSize(e->floatingWalls),
+        .numPickups = slotMapSize(e->pickups),
+        .numProjectiles = slotMapSize(e->projectiles),
+        .numPieces = slotMapSize(e->dronePieces),
+    };
+    memcpy(header.stats, e->stats, sizeof(e->stats));
+    memcpy(header.spawnedWeaponPickups, e->spawnedWeaponPickups, sizeof(e->spawnedWeaponPickups));
+    // sudden death walls are always at the end of the static walls
+    for (int16_t i = cc_array_size(e->walls) - 1; i >= 0; i--) {
+        const wallEntity *wall = safe_array_get_at(e->walls, i);
+        if (!wall->isSuddenDeath) {
+            break;
+        }
+        header.numSuddenDeathWalls++;
+    }
+    serializeHeader(&c, &header);
+
+    envStateField(&c, latestObs(e), e->obsBytes * e->numAgents);
+    envStateField(&c, e->rewards, e->numAgents * sizeof(float));
+    envStateField(&c, e->masks, e->numAgents * sizeof(uint8_t));
+    envStateField(&c, e->terminals, e->numAgents * sizeof(uint8_t));
+    envStateField(&c, e->truncations, e->numAgents * sizeof(uint8_t));
+
+    for (uint16_t i = cc_array_size(e->walls) - header.numSuddenDeathWalls; i < cc_array_size(e->walls); i++) {
+        const wallEntity *wall = safe_array_get_at(e->walls, i);
+        int16_t mapCellIdx = wall->mapCellIdx;
+        STATE_FIELD(&c, mapCellIdx);
+    }
+
+    for (uint16_t i = 0; i < header.numFloatingWalls; i++) {
+        savedFloatingWall saved = saveFloatingWall(slotMapGetAt(e->floatingWalls, i));
+        serializeFloatingWall(&c, &saved);
+    }
+
+    for (uint16_t i = 0; i < header.numPickups; i++) {
+        savedPickup saved = savePickup(slotMapGetAt(e->pickups, i));
+        serializePickup(&c, &saved);
+    }
+
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        savedDrone saved = saveDrone(safe_array_get_at(e->drones, i));
+        serializeDrone(&c, &saved);
+    }
+
+    for (uint16_t i = 0; i < header.numProjectiles; i++) {
+        savedProjectile saved = saveProjectile(e, slotMapGetAt(e->projectiles, i));
+        serializeProjectile(&c, &saved);
+    }
+
+    for (uint16_t i = 0; i < header.numPieces; i++) {
+        savedPiece saved = savePiece(slotMapGetAt(e->dronePieces, i));
+        serializePiece(&c, &saved);
+    }
+
+    // the size is serialized right after the version
+    header.size = s->size;
+    memcpy(s->data + sizeof(header.version), &header.size, sizeof(header.size));
+}
+
+static void restoreSuddenDeathWall(env *e, const int16_t mapCellIdx) {
+    mapCell *cell = &e->cells[mapCellIdx];
+    cell->ent = createWall(e, cell->pos, WALL_THICKNESS, WALL_THICKNESS, mapCellIdx, DEATH_WALL_ENTITY, false);
+}
+
+static void restoreFloatingWall(env *e, const savedFloatingWall *saved) {
+    entity *ent = createWall(e, saved->pos, saved->extent.x * 2.0f, saved->extent.y * 2.0f, saved->mapCellIdx, saved->type, true);
+    wallEntity *wall = ent->entity;
+    wall->rot = saved->rot;
+    wall->velocity = saved->velocity;
+    restoreBody(wall->bodyID, &saved->body);
+}
+
+static void restorePickup(env *e, const savedPickup *saved) {
+    weaponPickupEntity *pickup = poolAlloc(&e->pickupPool);
+    pickup->weapon = saved->weapon;
+    pickup->respawnWait = saved->respawnWait;
+    pickup->pos = saved->pos;
+    pickup->mapCellIdx = saved->mapCellIdx;
+    pickup->bodyDestroyed = saved->bodyDestroyed;
+    // begin touch events will be reported again for any overlapping
+    // floating walls
+    pickup->floatingWallsTouching = 0;
+
+    entity *ent = poolAlloc(&e->entityPool);
+    ent->type = WEAPON_PICKUP_ENTITY;
+    ent->entity = pickup;
+    pickup->ent = ent;
+
+    if (!saved->bodyDestroyed) {
+        createWeaponPickupBodyShape(e, pickup);
+        if (pickup->respawnWait != 0.0f) {
+            b2Body_Disable(pickup->bodyID);
+        }
+    }
+    if (pickup->respawnWait == 0.0f) {
+        e->cells[pickup->mapCellIdx].ent = ent;
+    }
+
+    pickup->handle = slotMapInsert(e->pickups, pickup);
+}
+
+static void restoreDrone(env *e, const savedDrone *saved) {
+    droneEntity *drone = createDroneAt(e, saved->idx, saved->pos);
+    drone->team = saved->team;
+    drone->weaponInfo = weaponInfos[saved->weapon];
+    drone->ammo = saved->ammo;
+    drone->weaponCooldown = saved->weaponCooldown;
+    drone->heat = saved->heat;
+    drone->chargingWeapon = saved->chargingWeapon;
+    drone->weaponCharge = saved->weaponCharge;
+    drone->energyLeft = saved->energyLeft;
+    drone->braking = saved->braking;
+    drone->chargingBurst = saved->chargingBurst;
+    drone->burstCharge = saved->burstCharge;
+    drone->burstCooldown = saved->burstCooldown;
+    drone->energyFullyDepleted = saved->energyFullyDepleted;
+    drone->energyFullyDepletedThisStep = saved->energyFullyDepletedThisStep;
+    drone->energyRefillWait = saved->energyRefillWait;
+    drone->shotThisStep = saved->shotThisStep;
+    drone->diedThisStep = saved->diedThisStep;
+
+    drone->initalPos = saved->initalPos;
+    drone->mapCellIdx = saved->mapCellIdx;
+    drone->lastPos = saved->lastPos;
+    drone->lastMove = saved->lastMove;
+    drone->lastAim = saved->lastAim;
+    drone->velocity = saved->velocity;
+    drone->lastVelocity = saved->lastVelocity;
+    drone->respawnWait = saved->respawnWait;
+    drone->livesLeft = saved->livesLeft;
+    drone->dead = saved->dead;
+
+    restoreBody(drone->bodyID, &saved->body);
+    if (drone->braking) {
+        b2Body_SetLinearDamping(drone->bodyID, DRONE_LINEAR_DAMPING * DRONE_BRAKE_DAMPING_COEF);
+    }
+
+    if (saved->hasShield) {
+        createDroneShield(e, drone, -(drone->idx + 1));
+        shieldEntity *shield = drone->shield;
+        shield->pos = saved->shield.pos;
+        shield->health = saved->shield.health;
+        shield->duration = saved->shield.duration;
+        restoreBody(shield->bodyID, &saved->shield.body);
+    }
+}
+
+static void restoreProjectile(env *e, const savedProjectile *saved) {
+    const weaponInformation *weaponInfo = weaponInfos[saved->weapon];
+    const projectileBody body = acquireProjectileBody(e, weaponInfo, saved->pos);
+
+    projectileEntity *projectile = poolAlloc(&e->projectilePool);
+    projectile->droneIdx = saved->droneIdx;
+    projectile->bodyID = body.bodyID;
+    projectile->shapeID = body.shapeID;
+    projectile->sensorID = body.sensorID;
+    projectile->weaponInfo = weaponInfos[saved->weapon];
+    projectile->pos = saved->pos;
+    projectile->mapCellIdx = saved->mapCellIdx;
+    projectile->velocity = saved->velocity;
+    projectile->lastVelocity = saved->lastVelocity;
+    projectile->speed = saved->speed;
+    projectile->lastSpeed = saved->lastSpeed;
+    projectile->bounces = saved->bounces;
+    projectile->setMine = saved->setMine;
+    projectile->needsToBeDestroyed = saved->needsToBeDestroyed;
+    projectile->numDronesBehindWalls = saved->numDronesBehindWalls;
+    memcpy(projectile->dronesBehindWalls, saved->dronesBehindWalls, sizeof(projectile->dronesBehindWalls));
+    // begin contact events will be reported again for anything the
+    // projectile is touching
+    projectile->contacts = 0;
+    if (e->client != NULL) {
+        projectile->trailPoints = poolAlloc(&e->projectileTrailPool);
+    }
+
+    projectile->handle = slotMapInsert(e->projectiles, projectile);
+    setProjectileColumns(e, projectile);
+    const uint16_t col = projectileCol(projectile);
+    e->projectileCols.lastPosX[col] = saved->lastPos.x;
+    e->projectileCols.lastPosY[col] = saved->lastPos.y;
+    e->projectileCols.distance[col] = saved->distance;
+
+    entity *ent = poolAlloc(&e->entityPool);
+    ent->type = PROJECTILE_ENTITY;
+    ent->entity = projectile;
+
+    projectile->ent = ent;
+    b2Body_SetUserData(projectile->bodyID, ent);
+    b2Shape_SetUserData(projectile->shapeID, ent);
+    if (projectile->weaponInfo->proximityDetonates) {
+        b2Shape_SetUserData(projectile->sensorID, ent);
+    }
+
+    restoreBody(projectile->bodyID, &saved->body);
+    restoreWeld(e, projectile, &saved->weld);
+}
+
+static void restorePiece(env *e, const savedPiece *saved) {
+    dronePieceEntity *piece = poolAlloc(&e->dronePiecePool);
+    piece->droneIdx = saved->droneIdx;
+    piece->pos = saved->pos;
+    piece->rot = saved->rot;
+    memcpy(piece->vertices, saved->vertices, sizeof(piece->vertices));
+    piece->isShieldPiece = saved->isShieldPiece;
+    piece->lifetime = saved->lifetime;
+
+    entity *ent = poolAlloc(&e->entityPool);
+    ent->type = DRONE_PIECE_ENTITY;
+    ent->entity = piece;
+    piece->ent = ent;
+
+    createDronePieceBody(e, piece, saved->body.linearVelocity, saved->body.angularVelocity);
+    restoreBody(piece->bodyID, &saved->body);
+
+    piece->handle = slotMapInsert(e->dronePieces, piece);
+}
+
+static inline bool stateCellIdxValid(const mapEntry *map, const int16_t cellIdx, const bool allowNone) {
+    if (cellIdx == -1) {
+        return allowNone;
+    }
+    return cellIdx >= 0 && cellIdx < map->columns * map->rows;
+}
+
+static inline bool stateWeaponValid(const uint8_t weapon) {
+    return weapon < NUM_WEAPONS;
+}
+
+// checks that every record of a state is in bounds and that every index
+// it holds is valid for e and the state's map, so a state can be
+// rejected before e is changed at all
+static enum envStateStatus validateEnvState(const env *e, const envState *s) {
+    envStateCursor c = {.src = s};
+    savedEnvHeader header;
+    serializeHeader(&c, &header);
+    if (c.overrun) {
+        return ENV_STATE_SIZE_MISMATCH;
+    }
+    if (header.version != ENV_STATE_VERSION) {
+        return ENV_STATE_VERSION_MISMATCH;
+    }
+    if (header.size != s->size) {
+        return ENV_STATE_SIZE_MISMATCH;
+    }
+    if (header.numDrones != e->numDrones || header.numAgents != e->numAgents || header.obsBytes != e->obsBytes) {
+        return ENV_STATE_ENV_MISMATCH;
+    }
+    if (header.mapIdx < 0 || header.mapIdx >= NUM_MAPS) {
+        return ENV_STATE_INVALID;
+    }
+    const mapEntry *map = maps[header.mapIdx];
+    const uint16_t numCells = map->columns * map->rows;
+    if (!stateWeaponValid(header.defaultWeapon) || header.lastSpawnQuad < 0 || header.lastSpawnQuad > 3) {
+        return ENV_STATE_INVALID;
+    }
+    if (header.suddenDeathWallCounter > min(map->columns, map->rows) / 2) {
+        return ENV_STATE_INVALID;
+    }
+    if (header.numSuddenDeathWalls > numCells || header.numFloatingWalls > MAX_FLOATING_WALLS || header.numPickups > MAX_WEAPON_PICKUPS) {
+        return ENV_STATE_INVALID;
+    }
+
+    envStateSkip(&c, (e->obsBytes * e->numAgents) + (e->numAgents * (sizeof(float) + (3 * sizeof(uint8_t)))));
+
+    for (uint16_t i = 0; i < header.numSuddenDeathWalls && !c.overrun; i++) {
+        int16_t mapCellIdx;
+        STATE_FIELD(&c, mapCellIdx);
+        if (!c.overrun && !stateCellIdxValid(map, mapCellIdx, false)) {
+            return ENV_STATE_INVALID;
+        }
+    }
+
+    for (uint16_t i = 0; i < header.numFloatingWalls && !c.overrun; i++) {
+        savedFloatingWall saved;
+        serializeFloatingWall(&c, &saved);
+        if (!c.overrun && (!entityTypeIsWall(saved.type) || !stateCellIdxValid(map, saved.mapCellIdx, false))) {
+            return ENV_STATE_INVALID;
+        }
+    }
+
+    for (uint16_t i = 0; i < header.numPickups && !c.overrun; i++) {
+        savedPickup saved;
+        serializePickup(&c, &saved);
+        if (!c.overrun && (!stateWeaponValid(saved.weapon) || !stateCellIdxValid(map, saved.mapCellIdx, false))) {
+            return ENV_STATE_INVALID;
+        }
+    }
+
+    for (uint8_t i = 0; i < header.numDrones && !c.overrun; i++) {
+        savedDrone saved;
+        serializeDrone(&c, &saved);
+        if (c.overrun) {
+            break;
+        }
+        if (saved.idx != i || saved.team >= e->numTeams || !stateWeaponValid(saved.weapon) || !stateCellIdxValid(map, saved.mapCellIdx, true)) {
+            return ENV_STATE_INVALID;
+        }
+    }
+
+    for (uint16_t i = 0; i < header.numProjectiles && !c.overrun; i++) {
+        savedProjectile saved;
+        serializeProjectile(&c, &saved);
+        if (c.overrun) {
+            break;
+        }
+        if (!stateWeaponValid(saved.weapon) || saved.droneIdx >= e->numDrones || !stateCellIdxValid(map, saved.mapCellIdx, true)) {
+            return ENV_STATE_INVALID;
+        }
+        if (saved.numDronesBehindWalls > _MAX_DRONES) {
+            return ENV_STATE_INVALID;
+        }
+        for (uint8_t j = 0; j < saved.numDronesBehindWalls; j++) {
+            if (saved.dronesBehindWalls[j] >= e->numDrones) {
+                return ENV_STATE_INVALID;
+            }
+        }
+
+        const savedWeld *weld = &saved.weld;
+        if (!weld->welded) {
+            continue;
+        }
+        // sudden death walls are restored after the static walls of the map
+        uint16_t numWalls = map->numWalls + header.numSuddenDeathWalls;
+        if (weld->floatingWall) {
+            numWalls = header.numFloatingWalls;
+        } else if (weld->mergedWall) {
+            numWalls = map->numMergedWalls;
+        }
+        if (weld->wallIdx >= numWalls) {
+            return ENV_STATE_INVALID;
+        }
+    }
+
+    for (uint16_t i = 0; i < header.numPieces && !c.overrun; i++) {
+        savedPiece saved;
+        serializePiece(&c, &saved);
+        if (!c.overrun && saved.droneIdx >= e->numDrones) {
+            return ENV_STATE_INVALID;
+        }
+    }
+
+    if (c.overrun || c.offset != s->size) {
+        return ENV_STATE_SIZE_MISMATCH;
+    }
+    return ENV_STATE_OK;
+}
+
+// restores a state saved by saveEnvState into e, which must have been
+// initialized with the same number of drones and agents as the env the
+// state was saved from; e may already be in use; the whole state is
+// validated first and e is left unchanged if it's invalid
+enum envStateStatus restoreEnvState(env *e, const envState *s) {
+    const enum envStateStatus status = validateEnvState(e, s);
+    if (status != ENV_STATE_OK) {
+        return status;
+    }
+
+    envStateCursor c = {.src = s};
+    savedEnvHeader header;
+    serializeHeader(&c, &header);
+
+    clearEnv(e);
+    if (e->mapIdx != header.mapIdx) {
+        // set floating walls are restored with the rest of the floating
+        // walls
+        setupMap(e, header.mapIdx);
+        for (uint16_t i = 0; i < slotMapSize(e->floatingWalls); i++) {
+            wallEntity *wall = slotMapGetAt(e->floatingWalls, i);
+            destroyWall(e, wall, false);
+        }
+        slotMapClear(e->floatingWalls);
+    } else {
+        removeSuddenDeathWalls(e);
+    }
+    e->defaultWeapon = weaponInfos[header.defaultWeapon];
+
+    envStateField(&c, latestObs(e), e->obsBytes * e->numAgents);
+    envStateField(&c, e->rewards, e->numAgents * sizeof(float));
+    envStateField(&c, e->masks, e->numAgents * sizeof(uint8_t));
+    envStateField(&c, e->terminals, e->numAgents * sizeof(uint8_t));
+    envStateField(&c, e->truncations, e->numAgents * sizeof(uint8_t));
+
+    // walls copy suddenDeathWallsPlaced when created
+    e->suddenDeathWallsPlaced = true;
+    for (uint16_t i = 0; i < header.numSuddenDeathWalls; i++) {
+        int16_t mapCellIdx;
+        STATE_FIELD(&c, mapCellIdx);
+        restoreSuddenDeathWall(e, mapCellIdx);
+    }
+    e->suddenDeathWallsPlaced = header.suddenDeathWallsPlaced;
+
+    for (uint16_t i = 0; i < header.numFloatingWalls; i++) {
+        savedFloatingWall saved;
+        serializeFloatingWall(&c, &saved);
+        restoreFloatingWall(e, &saved);
+    }
+
+    for (uint16_t i = 0; i < header.numPickups; i++) {
+        savedPickup saved;
+        serializePickup(&c, &saved);
+        restorePickup(e, &saved);
+    }
+
+    for (uint8_t i = 0; i < header.numDrones; i++) {
+        savedDrone saved;
+        serializeDrone(&c, &saved);
+        restoreDrone(e, &saved);
+    }
+
+    for (uint16_t i = 0; i < header.numProjectiles; i++) {
+        savedProjectile saved;
+        serializeProjectile(&c, &saved);
+        restoreProjectile(e, &saved);
+    }
+
+    for (uint16_t i = 0; i < header.numPieces; i++) {
+        savedPiece saved;
+        serializePiece(&c, &saved);
+        restorePiece(e, &saved);
+    }
+    ASSERT(!c.overrun && c.offset == s->size);
+
+    e->lastSpawnQuad = header.lastSpawnQuad;
+    e->randState = header.randState;
+    e->needsReset = header.needsReset;
+    e->episodeLength = header.episodeLength;
+    memcpy(e->stats, header.stats, e->numDrones * sizeof(droneStats));
+    e->stepsLeft = header.stepsLeft;
+    e->suddenDeathSteps = header.suddenDeathSteps;
+    e->suddenDeathWallCounter = header.suddenDeathWallCounter;
+    memcpy(e->spawnedWeaponPickups, header.spawnedWeaponPickups, sizeof(e->spawnedWeaponPickups));
+
+    return ENV_STATE_OK;
+}
+
+// copies the state of src into dst using scratch as the intermediate
+// buffer; dst must have been initialized with the same number of drones
+// and agents as src
+void cloneEnv(env *dst, const env *src, envState *scratch) {
+    ASSERT(dst != src);
+    saveEnvState(src, scratch);
+    const enum envStateStatus status = restoreEnvState(dst, scratch);
+    ASSERTF(status == ENV_STATE_OK, "status: %s", envStateStatusMessage(status));
+    MAYBE_UNUSED(status);
+}
+
+#endif
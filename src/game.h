@@ -5,6 +5,7 @@
 #include "helpers.h"
 #include "settings.h"
 #include "types.h"
+#include "visibility.h"
 
 // these functions call each other so need to be forward declared
 void destroyProjectile(env *e, projectileEntity *projectile, const bool processExplosions, const bool full);
@@ -12,15 +13,15 @@ void createExplosion(env *e, droneEntity *drone, const projectileEntity *project
 
 void updateTrailPoints(const env *e, trailPoints *tp, const uint8_t maxLen, const b2Vec2 pos);
 
-static inline bool entityTypeIsWall(const enum entityType type) {
-    // walls are the first 3 entity types
-    return type <= DEATH_WALL_ENTITY;
-}
-
 static inline int16_t cellIndex(const env *e, const int8_t col, const int8_t row) {
     return col + (row * e->map->columns);
 }
 
+// paths to the same destination cell are stored contiguously
+static inline uint32_t mapPathOffset(const mapEntry *map, const uint16_t srcCellIdx, const uint16_t destCellIdx) {
+    return ((uint32_t)destCellIdx * map->columns * map->rows) + srcCellIdx;
+}
+
 // discretizes an entity's position into a cell index; -1 is returned if
 // the position is out of bounds of the map
 static inline int16_t entityPosToCellIdx(const env *e, const b2Vec2 pos) {
@@ -30,7 +31,7 @@ static inline int16_t entityPosToCellIdx(const env *e, const b2Vec2 pos) {
     const int8_t cellRow = cellY / WALL_THICKNESS;
     const int16_t cellIdx = cellIndex(e, cellCol, cellRow);
     // set the cell to -1 if it's out of bounds
-    if (cellIdx < 0 || (uint16_t)cellIdx >= cc_array_size(e->cells)) {
+    if (cellIdx < 0 || (uint16_t)cellIdx >= e->numCells) {
         DEBUG_LOGF("invalid cell index: %d from position: (%f, %f)", cellIdx, pos.x, pos.y);
         return -1;
     }
@@ -171,6 +172,34 @@ float posBehindWallCallback(b2ShapeId shapeID, b2Vec2 point, b2Vec2 normal, floa
     return 0;
 }
 
+bool castRayBehindWall(const env *e, const b2Vec2 startPos, const b2Vec2 endPos, const entity *srcEnt, const b2QueryFilter filter, const enum entityType *targetType) {
+    const b2Vec2 translation = b2Sub(endPos, startPos);
+    behindWallContext ctx = {
+        .srcEnt = srcEnt,
+        .targetType = targetType,
+        .hit = false,
+    };
+    b2World_CastRay(e->worldID, startPos, translation, filter, posBehindWallCallback, &ctx);
+    return ctx.hit;
+}
+
+// returns true if the grid walk's answer of hit agrees with box2d about
+// static walls; rays that graze the edge or corner of a wall can be
+// answered differently by each, so only disagreements that hold for
+// rays nudged to either side count
+bool staticWallSightAgrees(const env *e, const b2Vec2 startPos, const b2Vec2 endPos, const entity *srcEnt, const b2QueryFilter filter, const enum entityType *targetType, const bool hit) {
+    const b2QueryFilter wallFilter = {.categoryBits = filter.categoryBits, .maskBits = WALL_SHAPE};
+    if (castRayBehindWall(e, startPos, endPos, srcEnt, wallFilter, targetType) == hit) {
+        return true;
+    }
+
+    const float tolerance = 0.01f;
+    const b2Vec2 offset = b2MulSV(tolerance, b2LeftPerp(b2Normalize(b2Sub(endPos, startPos))));
+    const bool leftHit = castRayBehindWall(e, b2Add(startPos, offset), b2Add(endPos, offset), srcEnt, wallFilter, targetType);
+    const bool rightHit = castRayBehindWall(e, b2Sub(startPos, offset), b2Sub(endPos, offset), srcEnt, wallFilter, targetType);
+    return leftHit == hit || rightHit == hit;
+}
+
 // returns true if there are shapes that match filter between startPos and endPos
 bool posBehindWall(const env *e, const b2Vec2 startPos, const b2Vec2 endPos, const entity *srcEnt, const b2QueryFilter filter, const enum entityType *targetType) {
     const float rayDistance = b2Distance(startPos, endPos);
@@ -180,14 +209,32 @@ bool posBehindWall(const env *e, const b2Vec2 startPos, const b2Vec2 endPos, con
         return false;
     }
 
-    const b2Vec2 translation = b2Sub(endPos, startPos);
-    behindWallContext ctx = {
-        .srcEnt = srcEnt,
-        .targetType = targetType,
-        .hit = false,
-    };
-    b2World_CastRay(e->worldID, startPos, translation, filter, posBehindWallCallback, &ctx);
-    return ctx.hit;
+    // the grid can only answer for walls, and only for shape categories
+    // that static walls collide with
+    const uint64_t wallMask = WALL_SHAPE | FLOATING_WALL_SHAPE;
+    const uint64_t gridCategories = PROJECTILE_SHAPE | DRONE_SHAPE;
+    if ((filter.maskBits & ~wallMask) != 0 || (filter.categoryBits & ~gridCategories) != 0) {
+        return castRayBehindWall(e, startPos, endPos, srcEnt, filter, targetType);
+    }
+
+    // static walls are checked by walking the map cells the ray crosses,
+    // which is much cheaper than a box2d ray cast
+    if ((filter.maskBits & WALL_SHAPE) != 0) {
+        const bool hit = segmentHitsStaticWall(e, startPos, endPos, srcEnt, targetType);
+        ASSERTF(staticWallSightAgrees(e, startPos, endPos, srcEnt, filter, targetType, hit), "grid line of sight disagrees with box2d: start (%f, %f) end (%f, %f) grid hit: %d", startPos.x, startPos.y, endPos.x, endPos.y, hit);
+        if (hit) {
+            return true;
+        }
+    }
+
+    // floating walls move, so only fall back to box2d if one is close
+    // enough to the ray that it might block it
+    if ((filter.maskBits & FLOATING_WALL_SHAPE) != 0 && floatingWallNearSegment(e, startPos, endPos, srcEnt, targetType)) {
+        const b2QueryFilter floatingFilter = {.categoryBits = filter.categoryBits, .maskBits = FLOATING_WALL_SHAPE};
+        return castRayBehindWall(e, startPos, endPos, srcEnt, floatingFilter, targetType);
+    }
+
+    return false;
 }
 
 typedef struct overlapCircleCtx {
@@ -256,7 +303,7 @@ uint8_t cellOffsets[8][2] = {
 // will be returned
 bool findOpenPos(env *e, const enum shapeCategory shapeType, b2Vec2 *emptyPos, int8_t quad) {
     uint8_t checkedCells[BITNSLOTS(MAX_CELLS)] = {0};
-    const size_t nCells = cc_array_size(e->cells) - 1;
+    const size_t nCells = e->numCells - 1;
     uint16_t attempts = 0;
     bool skipDistanceChecks = false;
 
@@ -293,7 +340,7 @@ bool findOpenPos(env *e, const enum shapeCategory shapeType, b2Vec2 *emptyPos, i
         }
         bitSet(checkedCells, cellIdx);
 
-        const mapCell *cell = safe_array_get_at(e->cells, cellIdx);
+        const mapCell *cell = &e->cells[cellIdx];
         if (cell->ent != NULL) {
             continue;
         }
@@ -304,8 +351,8 @@ bool findOpenPos(env *e, const enum shapeCategory shapeType, b2Vec2 *emptyPos, i
         if (shapeType == WEAPON_PICKUP_SHAPE) {
             // ensure pickups don't spawn too close to other pickups
             bool tooClose = false;
-            for (uint8_t i = 0; i < cc_array_size(e->pickups); i++) {
-                const weaponPickupEntity *pickup = safe_array_get_at(e->pickups, i);
+            for (uint8_t i = 0; i < slotMapSize(e->pickups); i++) {
+                const weaponPickupEntity *pickup = slotMapGetAt(e->pickups, i);
                 if (b2DistanceSquared(cell->pos, pickup->pos) < PICKUP_SPAWN_DISTANCE_SQUARED) {
                     tooClose = true;
                     break;
@@ -330,7 +377,7 @@ bool findOpenPos(env *e, const enum shapeCategory shapeType, b2Vec2 *emptyPos, i
                         continue;
                     }
                     const int16_t testCellIdx = cellIndex(e, col, row);
-                    const mapCell *testCell = safe_array_get_at(e->cells, testCellIdx);
+                    const mapCell *testCell = &e->cells[testCellIdx];
                     if (testCell->ent != NULL && testCell->ent->type == DEATH_WALL_ENTITY) {
                         deathWallNeighboring = true;
                         break;
@@ -370,80 +417,121 @@ bool findOpenPos(env *e, const enum shapeCategory shapeType, b2Vec2 *emptyPos, i
     }
 }
 
-entity *createWall(const env *e, const b2Vec2 pos, const float width, const float height, int16_t cellIdx, const enum entityType type, const bool floating) {
+static wallEntity *newWall(env *e, const b2Vec2 pos, const b2Vec2 extent, const int16_t cellIdx, const enum entityType type, const bool floating) {
     ASSERT(cellIdx != -1);
     ASSERT(entityTypeIsWall(type));
 
+    wallEntity *wall = poolAlloc(&e->wallPool);
+    wall->pos = pos;
+    wall->rot = b2Rot_identity;
+    wall->velocity = b2Vec2_zero;
+    wall->extent = extent;
+    wall->mapCellIdx = cellIdx;
+    wall->isFloating = floating;
+    wall->type = type;
+    wall->isSuddenDeath = e->suddenDeathWallsPlaced;
+
+    entity *ent = poolAlloc(&e->entityPool);
+    ent->type = type;
+    ent->entity = wall;
+    wall->ent = ent;
+
+    return wall;
+}
+
+static void createWallBodyShape(const env *e, wallEntity *wall) {
     b2BodyDef wallBodyDef = b2DefaultBodyDef();
-    wallBodyDef.position = pos;
-    if (floating) {
+    wallBodyDef.position = wall->pos;
+    if (wall->isFloating) {
         wallBodyDef.type = b2_dynamicBody;
         wallBodyDef.linearDamping = FLOATING_WALL_DAMPING;
         wallBodyDef.angularDamping = FLOATING_WALL_DAMPING;
         wallBodyDef.isAwake = false;
     }
-    b2BodyId wallBodyID = b2CreateBody(e->worldID, &wallBodyDef);
+    wallBodyDef.userData = wall->ent;
+    wall->bodyID = b2CreateBody(e->worldID, &wallBodyDef);
 
-    b2Vec2 extent = {.x = width / 2.0f, .y = height / 2.0f};
     b2ShapeDef wallShapeDef = b2DefaultShapeDef();
     wallShapeDef.density = WALL_DENSITY;
     wallShapeDef.restitution = STANDARD_WALL_RESTITUTION;
     wallShapeDef.friction = STANDARD_WALL_FRICTION;
     wallShapeDef.filter.categoryBits = WALL_SHAPE;
     wallShapeDef.filter.maskBits = FLOATING_WALL_SHAPE | PROJECTILE_SHAPE | DRONE_SHAPE | SHIELD_SHAPE | DRONE_PIECE_SHAPE;
-    if (floating) {
+    if (wall->isFloating) {
         wallShapeDef.filter.categoryBits = FLOATING_WALL_SHAPE;
         wallShapeDef.filter.maskBits |= WALL_SHAPE | WEAPON_PICKUP_SHAPE;
         wallShapeDef.enableSensorEvents = true;
     }
 
-    if (type == BOUNCY_WALL_ENTITY) {
+    if (wall->type == BOUNCY_WALL_ENTITY) {
         wallShapeDef.restitution = BOUNCY_WALL_RESTITUTION;
         wallShapeDef.friction = 0.0f;
-    } else if (type == DEATH_WALL_ENTITY) {
+    } else if (wall->type == DEATH_WALL_ENTITY) {
         wallShapeDef.enableContactEvents = true;
     }
 
-    wallEntity *wall = fastCalloc(1, sizeof(wallEntity));
-    wall->bodyID = wallBodyID;
-    wall->pos = pos;
-    wall->rot = b2Rot_identity;
-    wall->velocity = b2Vec2_zero;
-    wall->extent = extent;
-    wall->mapCellIdx = cellIdx;
-    wall->isFloating = floating;
-    wall->type = type;
-    wall->isSuddenDeath = e->suddenDeathWallsPlaced;
-
-    entity *ent = fastCalloc(1, sizeof(entity));
-    ent->type = type;
-    ent->entity = wall;
+    wallShapeDef.userData = wall->ent;
+    const b2Polygon wallPolygon = b2MakeBox(wall->extent.x, wall->extent.y);
+    wall->shapeID = b2CreatePolygonShape(wall->bodyID, &wallShapeDef, &wallPolygon);
+}
 
-    wall->ent = ent;
-    wallShapeDef.userData = ent;
-    const b2Polygon wallPolygon = b2MakeBox(extent.x, extent.y);
-    wall->shapeID = b2CreatePolygonShape(wallBodyID, &wallShapeDef, &wallPolygon);
-    b2Body_SetUserData(wall->bodyID, ent);
+entity *createWall(env *e, const b2Vec2 pos, const float width, const float height, int16_t cellIdx, const enum entityType type, const bool floating) {
+    const b2Vec2 extent = {.x = width / 2.0f, .y = height / 2.0f};
+    wallEntity *wall = newWall(e, pos, extent, cellIdx, type, floating);
+    createWallBodyShape(e, wall);
 
     if (floating) {
-        cc_array_add(e->floatingWalls, wall);
+        wall->handle = slotMapInsert(e->floatingWalls, wall);
     } else {
         cc_array_add(e->walls, wall);
     }
 
-    return ent;
+    return wall->ent;
+}
+
+// creates a static wall covering columns x rows cells starting from the
+// top left cell cellIdx; the walls of the covered cells have to be
+// created with createCellWall
+wallEntity *createMergedWall(env *e, const int16_t cellIdx, const uint8_t columns, const uint8_t rows, const enum entityType type) {
+    const b2Vec2 startPos = e->cells[cellIdx].pos;
+    const b2Vec2 endPos = e->cells[cellIdx + (columns - 1) + ((rows - 1) * e->map->columns)].pos;
+    const b2Vec2 pos = b2MulSV(0.5f, b2Add(startPos, endPos));
+    const b2Vec2 extent = {.x = columns * WALL_THICKNESS / 2.0f, .y = rows * WALL_THICKNESS / 2.0f};
+
+    wallEntity *wall = newWall(e, pos, extent, cellIdx, type, false);
+    wall->mergedColumns = columns;
+    wall->mergedRows = rows;
+    createWallBodyShape(e, wall);
+    cc_array_add(e->mergedWalls, wall);
+
+    return wall;
 }
 
-void destroyWall(const env *e, wallEntity *wall, const bool full) {
-    fastFree(wall->ent);
+// creates the wall of a single cell that is covered by a merged wall
+entity *createCellWall(env *e, wallEntity *merged, const int16_t cellIdx) {
+    const b2Vec2 extent = {.x = WALL_THICKNESS / 2.0f, .y = WALL_THICKNESS / 2.0f};
+    wallEntity *wall = newWall(e, e->cells[cellIdx].pos, extent, cellIdx, merged->type, false);
+    wall->merged = merged;
+    wall->bodyID = merged->bodyID;
+    wall->shapeID = merged->shapeID;
+    cc_array_add(e->walls, wall);
+
+    return wall->ent;
+}
+
+void destroyWall(env *e, wallEntity *wall, const bool full) {
+    poolFree(&e->entityPool, wall->ent);
 
     if (full) {
-        mapCell *cell = safe_array_get_at(e->cells, wall->mapCellIdx);
+        mapCell *cell = &e->cells[wall->mapCellIdx];
         cell->ent = NULL;
     }
 
-    b2DestroyBody(wall->bodyID);
-    fastFree(wall);
+    // walls of cells covered by a merged wall share its body
+    if (wall->merged == NULL) {
+        b2DestroyBody(wall->bodyID);
+    }
+    poolFree(&e->wallPool, wall);
 }
 
 enum weaponType randWeaponPickupType(env *e) {
@@ -504,13 +592,13 @@ void createWeaponPickup(env *e) {
         ERROR("no open position for weapon pickup");
     }
 
-    weaponPickupEntity *pickup = fastCalloc(1, sizeof(weaponPickupEntity));
+    weaponPickupEntity *pickup = poolAlloc(&e->pickupPool);
     pickup->weapon = randWeaponPickupType(e);
     pickup->respawnWait = 0.0f;
     pickup->floatingWallsTouching = 0;
     pickup->pos = pos;
 
-    entity *ent = fastCalloc(1, sizeof(entity));
+    entity *ent = poolAlloc(&e->entityPool);
     ent->type = WEAPON_PICKUP_ENTITY;
     ent->entity = pickup;
     pickup->ent = ent;
@@ -520,32 +608,34 @@ void createWeaponPickup(env *e) {
         ERRORF("invalid position for weapon pickup spawn: (%f, %f)", pos.x, pos.y);
     }
     pickup->mapCellIdx = cellIdx;
-    mapCell *cell = safe_array_get_at(e->cells, cellIdx);
+    mapCell *cell = &e->cells[cellIdx];
     cell->ent = ent;
 
     createWeaponPickupBodyShape(e, pickup);
 
-    cc_array_add(e->pickups, pickup);
+    pickup->handle = slotMapInsert(e->pickups, pickup);
 }
 
-void destroyWeaponPickup(const env *e, weaponPickupEntity *pickup) {
-    fastFree(pickup->ent);
+void destroyWeaponPickup(env *e, weaponPickupEntity *pickup) {
+    poolFree(&e->entityPool, pickup->ent);
 
-    mapCell *cell = safe_array_get_at(e->cells, pickup->mapCellIdx);
+    mapCell *cell = &e->cells[pickup->mapCellIdx];
     cell->ent = NULL;
 
     if (!pickup->bodyDestroyed) {
         b2DestroyBody(pickup->bodyID);
     }
 
-    fastFree(pickup);
+    poolFree(&e->pickupPool, pickup);
 }
 
-// destroys the pickup body and shape while the pickup is waiting to
-// respawn to avoid spurious sensor overlap checks; enabling/disabling
-// a body is almost as expensive and creating a new body in box2d, and
-// manually moving (teleporting) it is expensive as well so destroying
-// the body now and re-creating it later is the fastest
+// disables or destroys the pickup body and shape while the pickup is
+// waiting to respawn to avoid spurious sensor overlap checks;
+// enabling/disabling a body is almost as expensive as creating a new
+// body in box2d, and manually moving (teleporting) it is expensive as
+// well, so destroying the body now and re-creating it later is usually
+// the fastest; keeping the body only avoids allocating a new body and
+// shape, see PERSISTENT_PICKUP_BODIES
 void disableWeaponPickup(env *e, weaponPickupEntity *pickup) {
     DEBUG_LOGF("disabling weapon pickup at cell %d (%f, %f)", pickup->mapCellIdx, pickup->pos.x, pickup->pos.y);
 
@@ -553,17 +643,21 @@ void disableWeaponPickup(env *e, weaponPickupEntity *pickup) {
     if (e->suddenDeathWallsPlaced) {
         pickup->respawnWait = SUDDEN_DEATH_PICKUP_RESPAWN_WAIT;
     }
-    b2DestroyBody(pickup->bodyID);
-    pickup->bodyDestroyed = true;
+    if (PERSISTENT_PICKUP_BODIES) {
+        b2Body_Disable(pickup->bodyID);
+    } else {
+        b2DestroyBody(pickup->bodyID);
+        pickup->bodyDestroyed = true;
+    }
 
-    mapCell *cell = safe_array_get_at(e->cells, pickup->mapCellIdx);
+    mapCell *cell = &e->cells[pickup->mapCellIdx];
     ASSERT(cell->ent != NULL);
     cell->ent = NULL;
 
     e->spawnedWeaponPickups[pickup->weapon]--;
 }
 
-void createDroneShield(const env *e, droneEntity *drone, const int8_t groupIdx) {
+void createDroneShield(env *e, droneEntity *drone, const int8_t groupIdx) {
     // the shield is comprised of 2 shapes over 2 bodies:
     // 1. a kinematic body that allows the parent drone to be unaffected
     // by collisions since kinematic bodies have essentially infinite mass
@@ -591,7 +685,7 @@ void createDroneShield(const env *e, droneEntity *drone, const int8_t groupIdx)
     shieldBufferShapeDef.filter.maskBits = WALL_SHAPE | FLOATING_WALL_SHAPE | SHIELD_SHAPE;
     shieldBufferShapeDef.filter.groupIndex = groupIdx;
 
-    shieldEntity *shield = fastCalloc(1, sizeof(shieldEntity));
+    shieldEntity *shield = poolAlloc(&e->shieldPool);
     shield->drone = drone;
     shield->bodyID = shieldBodyID;
     shield->pos = drone->pos;
@@ -602,7 +696,7 @@ void createDroneShield(const env *e, droneEntity *drone, const int8_t groupIdx)
     }
     shield->duration = duration;
 
-    entity *shieldEnt = fastCalloc(1, sizeof(entity));
+    entity *shieldEnt = poolAlloc(&e->entityPool);
     shieldEnt->type = SHIELD_ENTITY;
     shieldEnt->entity = shield;
 
@@ -619,30 +713,11 @@ void createDroneShield(const env *e, droneEntity *drone, const int8_t groupIdx)
     drone->shield = shield;
 }
 
-void createDrone(env *e, const uint8_t idx) {
-    const int8_t groupIdx = -(idx + 1);
+// creates a drone and its body at pos without a shield
+droneEntity *createDroneAt(env *e, const uint8_t idx, const b2Vec2 pos) {
     b2BodyDef droneBodyDef = b2DefaultBodyDef();
     droneBodyDef.type = b2_dynamicBody;
-
-    int8_t spawnQuad = -1;
-    if (!e->isTraining) {
-        // spawn drones in diagonal quadrants from each other so that
-        // they're more likely to be further apart if we're not training;
-        // doing this while training will result in much slower learning
-        // due to drones starting much farther apart
-        if (e->lastSpawnQuad == -1) {
-            spawnQuad = randInt(&e->randState, 0, 3);
-        } else if (e->numDrones == 2) {
-            spawnQuad = 3 - e->lastSpawnQuad;
-        } else {
-            spawnQuad = (e->lastSpawnQuad + 1) % 4;
-        }
-        e->lastSpawnQuad = spawnQuad;
-    }
-    if (!findOpenPos(e, DRONE_SHAPE, &droneBodyDef.position, spawnQuad)) {
-        ERROR("no open position for drone");
-    }
-
+    droneBodyDef.position = pos;
     droneBodyDef.fixedRotation = true;
     droneBodyDef.linearDamping = DRONE_LINEAR_DAMPING;
     b2BodyId droneBodyID = b2CreateBody(e->worldID, &droneBodyDef);
@@ -652,12 +727,12 @@ void createDrone(env *e, const uint8_t idx) {
     droneShapeDef.restitution = DRONE_RESTITUTION;
     droneShapeDef.filter.categoryBits = DRONE_SHAPE;
     droneShapeDef.filter.maskBits = WALL_SHAPE | FLOATING_WALL_SHAPE | WEAPON_PICKUP_SHAPE | PROJECTILE_SHAPE | DRONE_SHAPE | SHIELD_SHAPE;
-    droneShapeDef.filter.groupIndex = groupIdx;
+    droneShapeDef.filter.groupIndex = -(idx + 1);
     droneShapeDef.enableContactEvents = true;
     droneShapeDef.enableSensorEvents = true;
     const b2Circle droneCircle = {.center = b2Vec2_zero, .radius = DRONE_RADIUS};
 
-    droneEntity *drone = fastCalloc(1, sizeof(droneEntity));
+    droneEntity *drone = poolAlloc(&e->dronePool);
     drone->bodyID = droneBodyID;
     drone->weaponInfo = e->defaultWeapon;
     drone->ammo = weaponAmmo(e->defaultWeapon->type, drone->weaponInfo->type);
@@ -667,15 +742,15 @@ void createDrone(env *e, const uint8_t idx) {
     if (e->teamsEnabled) {
         drone->team = idx / (e->numDrones / 2);
     }
-    drone->initalPos = droneBodyDef.position;
-    drone->pos = droneBodyDef.position;
-    drone->mapCellIdx = entityPosToCellIdx(e, droneBodyDef.position);
+    drone->initalPos = pos;
+    drone->pos = pos;
+    drone->mapCellIdx = entityPosToCellIdx(e, pos);
     drone->lastAim = (b2Vec2){.x = 0.0f, .y = -1.0f};
     drone->livesLeft = DRONE_LIVES;
     drone->respawnGuideLifetime = UINT16_MAX;
     memset(&drone->stepInfo, 0x0, sizeof(droneStepInfo));
 
-    entity *ent = fastCalloc(1, sizeof(entity));
+    entity *ent = poolAlloc(&e->entityPool);
     ent->type = DRONE_ENTITY;
     ent->entity = drone;
 
@@ -686,7 +761,32 @@ void createDrone(env *e, const uint8_t idx) {
 
     cc_array_add(e->drones, drone);
 
-    createDroneShield(e, drone, groupIdx);
+    return drone;
+}
+
+void createDrone(env *e, const uint8_t idx) {
+    int8_t spawnQuad = -1;
+    if (!e->isTraining) {
+        // spawn drones in diagonal quadrants from each other so that
+        // they're more likely to be further apart if we're not training;
+        // doing this while training will result in much slower learning
+        // due to drones starting much farther apart
+        if (e->lastSpawnQuad == -1) {
+            spawnQuad = randInt(&e->randState, 0, 3);
+        } else if (e->numDrones == 2) {
+            spawnQuad = 3 - e->lastSpawnQuad;
+        } else {
+            spawnQuad = (e->lastSpawnQuad + 1) % 4;
+        }
+        e->lastSpawnQuad = spawnQuad;
+    }
+    b2Vec2 pos;
+    if (!findOpenPos(e, DRONE_SHAPE, &pos, spawnQuad)) {
+        ERROR("no open position for drone");
+    }
+
+    droneEntity *drone = createDroneAt(e, idx, pos);
+    createDroneShield(e, drone, -(idx + 1));
 }
 
 void droneAddEnergy(droneEntity *drone, float energy) {
@@ -698,42 +798,50 @@ void droneAddEnergy(droneEntity *drone, float energy) {
     }
 }
 
+// creates the body and shape of a drone piece from its position,
+// rotation and vertices
+void createDronePieceBody(const env *e, dronePieceEntity *piece, const b2Vec2 linearVelocity, const float angularVelocity) {
+    b2BodyDef pieceBodyDef = b2DefaultBodyDef();
+    pieceBodyDef.type = b2_dynamicBody;
+
+    pieceBodyDef.position = piece->pos;
+    pieceBodyDef.rotation = piece->rot;
+    pieceBodyDef.linearDamping = DRONE_PIECE_LINEAR_DAMPING;
+    pieceBodyDef.angularDamping = DRONE_PIECE_ANGULAR_DAMPING;
+    pieceBodyDef.linearVelocity = linearVelocity;
+    pieceBodyDef.angularVelocity = angularVelocity;
+    pieceBodyDef.userData = piece->ent;
+    piece->bodyID = b2CreateBody(e->worldID, &pieceBodyDef);
+
+    b2ShapeDef pieceShapeDef = b2DefaultShapeDef();
+    pieceShapeDef.filter.categoryBits = DRONE_PIECE_SHAPE;
+    pieceShapeDef.filter.maskBits = WALL_SHAPE | FLOATING_WALL_SHAPE | DRONE_PIECE_SHAPE;
+    pieceShapeDef.density = 1.0f;
+    pieceShapeDef.userData = piece->ent;
+
+    const b2Hull pieceHull = b2ComputeHull(piece->vertices, 3);
+    const b2Polygon piecePolygon = b2MakePolygon(&pieceHull, 0.0f);
+    piece->shapeID = b2CreatePolygonShape(piece->bodyID, &pieceShapeDef, &piecePolygon);
+}
+
 void createDronePiece(env *e, droneEntity *drone, const bool fromShield) {
     const float distance = randFloat(&e->randState, DRONE_PIECE_MIN_DISTANCE, DRONE_PIECE_MAX_DISTANCE);
     const b2Vec2 direction = {.x = randFloat(&e->randState, -1.0f, 1.0f), .y = randFloat(&e->randState, -1.0f, 1.0f)};
     const b2Vec2 pos = b2MulAdd(drone->pos, distance, direction);
     const b2Rot rot = b2MakeRot(randFloat(&e->randState, -PI, PI));
 
-    dronePieceEntity *piece = fastCalloc(1, sizeof(dronePieceEntity));
+    dronePieceEntity *piece = poolAlloc(&e->dronePiecePool);
     piece->droneIdx = drone->idx;
     piece->pos = pos;
     piece->rot = rot;
     piece->isShieldPiece = fromShield;
     piece->lifetime = UINT16_MAX;
 
-    entity *ent = fastCalloc(1, sizeof(entity));
+    entity *ent = poolAlloc(&e->entityPool);
     ent->type = DRONE_PIECE_ENTITY;
     ent->entity = piece;
     piece->ent = ent;
 
-    b2BodyDef pieceBodyDef = b2DefaultBodyDef();
-    pieceBodyDef.type = b2_dynamicBody;
-
-    pieceBodyDef.position = pos;
-    pieceBodyDef.rotation = rot;
-    pieceBodyDef.linearDamping = DRONE_PIECE_LINEAR_DAMPING;
-    pieceBodyDef.angularDamping = DRONE_PIECE_ANGULAR_DAMPING;
-    pieceBodyDef.linearVelocity = b2MulSV(randFloat(&e->randState, DRONE_PIECE_MIN_SPEED, DRONE_PIECE_MAX_SPEED), direction);
-    pieceBodyDef.angularVelocity = randFloat(&e->randState, -PI, PI);
-    pieceBodyDef.userData = ent;
-    piece->bodyID = b2CreateBody(e->worldID, &pieceBodyDef);
-
-    b2ShapeDef pieceShapeDef = b2DefaultShapeDef();
-    pieceShapeDef.filter.categoryBits = DRONE_PIECE_SHAPE;
-    pieceShapeDef.filter.maskBits = WALL_SHAPE | FLOATING_WALL_SHAPE | DRONE_PIECE_SHAPE;
-    pieceShapeDef.density = 1.0f;
-    pieceShapeDef.userData = ent;
-
     // make pieces from the shield a bit smaller
     if (fromShield) {
         piece->vertices[0] = (b2Vec2){.x = 0.0f, .y = -1.0f};
@@ -745,17 +853,17 @@ void createDronePiece(env *e, droneEntity *drone, const bool fromShield) {
         piece->vertices[2] = (b2Vec2){.x = 0.75f, .y = 0.0f};
     }
 
-    const b2Hull pieceHull = b2ComputeHull(piece->vertices, 3);
-    const b2Polygon piecePolygon = b2MakePolygon(&pieceHull, 0.0f);
-    piece->shapeID = b2CreatePolygonShape(piece->bodyID, &pieceShapeDef, &piecePolygon);
+    const b2Vec2 linearVelocity = b2MulSV(randFloat(&e->randState, DRONE_PIECE_MIN_SPEED, DRONE_PIECE_MAX_SPEED), direction);
+    const float angularVelocity = randFloat(&e->randState, -PI, PI);
+    createDronePieceBody(e, piece, linearVelocity, angularVelocity);
 
-    cc_array_add(e->dronePieces, piece);
+    piece->handle = slotMapInsert(e->dronePieces, piece);
 }
 
-void destroyDronePiece(dronePieceEntity *piece) {
+void destroyDronePiece(env *e, dronePieceEntity *piece) {
     b2DestroyBody(piece->bodyID);
-    fastFree(piece->ent);
-    fastFree(piece);
+    poolFree(&e->entityPool, piece->ent);
+    poolFree(&e->dronePiecePool, piece);
 }
 
 void destroyDroneShield(env *e, shieldEntity *shield, const bool createPieces) {
@@ -768,8 +876,8 @@ void destroyDroneShield(env *e, shieldEntity *shield, const bool createPieces) {
 
     b2DestroyBody(shield->bodyID);
     b2DestroyShape(shield->bufferShapeID, false);
-    fastFree(shield->ent);
-    fastFree(shield);
+    poolFree(&e->entityPool, shield->ent);
+    poolFree(&e->shieldPool, shield);
 
     if (!createPieces || health > 0.0f) {
         return;
@@ -782,7 +890,7 @@ void destroyDroneShield(env *e, shieldEntity *shield, const bool createPieces) {
 }
 
 void destroyDrone(env *e, droneEntity *drone) {
-    fastFree(drone->ent);
+    poolFree(&e->entityPool, drone->ent);
 
     shieldEntity *shield = drone->shield;
     if (shield != NULL) {
@@ -790,7 +898,7 @@ void destroyDrone(env *e, droneEntity *drone) {
     }
 
     b2DestroyBody(drone->bodyID);
-    fastFree(drone);
+    poolFree(&e->dronePool, drone);
 }
 
 void droneChangeWeapon(const env *e, droneEntity *drone, const enum weaponType newWeapon) {
@@ -853,6 +961,189 @@ bool respawnDrone(env *e, droneEntity *drone) {
     return true;
 }
 
+void initProjectileColumns(projectileColumns *cols, const uint16_t capacity) {
+    cols->posX = fastMalloc(capacity * sizeof(float));
+    cols->posY = fastMalloc(capacity * sizeof(float));
+    cols->lastPosX = fastMalloc(capacity * sizeof(float));
+    cols->lastPosY = fastMalloc(capacity * sizeof(float));
+    cols->distance = fastMalloc(capacity * sizeof(float));
+    cols->maxDistance = fastMalloc(capacity * sizeof(float));
+    cols->expired = fastMalloc(capacity * sizeof(uint8_t));
+    cols->capacity = capacity;
+}
+
+void destroyProjectileColumns(projectileColumns *cols) {
+    fastFree(cols->posX);
+    fastFree(cols->posY);
+    fastFree(cols->lastPosX);
+    fastFree(cols->lastPosY);
+    fastFree(cols->distance);
+    fastFree(cols->maxDistance);
+    fastFree(cols->expired);
+}
+
+// grow the columns to match the capacity of the projectile slot map
+static void growProjectileColumns(env *e) {
+    projectileColumns *cols = &e->projectileCols;
+    const uint16_t capacity = e->projectiles->capacity;
+    cols->posX = fastRealloc(cols->posX, capacity * sizeof(float));
+    cols->posY = fastRealloc(cols->posY, capacity * sizeof(float));
+    cols->lastPosX = fastRealloc(cols->lastPosX, capacity * sizeof(float));
+    cols->lastPosY = fastRealloc(cols->lastPosY, capacity * sizeof(float));
+    cols->distance = fastRealloc(cols->distance, capacity * sizeof(float));
+    cols->maxDistance = fastRealloc(cols->maxDistance, capacity * sizeof(float));
+    cols->expired = fastRealloc(cols->expired, capacity * sizeof(uint8_t));
+    cols->capacity = capacity;
+    e->heapAllocs++;
+}
+
+static inline uint16_t projectileCol(const projectileEntity *projectile) {
+    return slotHandleIdx(projectile->handle);
+}
+
+static inline float projectileDistance(const env *e, const projectileEntity *projectile) {
+    return e->projectileCols.distance[projectileCol(projectile)];
+}
+
+// initializes the columns of a newly inserted projectile
+static inline void setProjectileColumns(env *e, const projectileEntity *projectile) {
+    const uint16_t col = projectileCol(projectile);
+    if (col >= e->projectileCols.capacity) {
+        growProjectileColumns(e);
+    }
+
+    projectileColumns *cols = &e->projectileCols;
+    cols->posX[col] = projectile->pos.x;
+    cols->posY[col] = projectile->pos.y;
+    cols->lastPosX[col] = projectile->pos.x;
+    cols->lastPosY[col] = projectile->pos.y;
+    cols->distance[col] = 0.0f;
+    cols->maxDistance[col] = INFINITY;
+    if (projectile->weaponInfo->maxDistance != INFINITE) {
+        cols->maxDistance[col] = projectile->weaponInfo->maxDistance;
+    }
+    cols->expired[col] = false;
+}
+
+static inline void setProjectilePos(env *e, projectileEntity *projectile, const b2Vec2 pos) {
+    projectileColumns *cols = &e->projectileCols;
+    const uint16_t col = projectileCol(projectile);
+    cols->lastPosX[col] = cols->posX[col];
+    cols->lastPosY[col] = cols->posY[col];
+    cols->posX[col] = pos.x;
+    cols->posY[col] = pos.y;
+    projectile->pos = pos;
+}
+
+static void pushProjectileBody(env *e, projectileBodyList *list, const projectileBody *body) {
+    if (list->size == list->capacity) {
+        list->capacity = max(list->capacity * 2, 8);
+        list->bodies = fastRealloc(list->bodies, list->capacity * sizeof(projectileBody));
+        e->heapAllocs++;
+    }
+    list->bodies[list->size++] = *body;
+}
+
+// adds an item to an array the env uses while stepping, counting the
+// reallocation if the array has to grow
+static inline void envArrayAdd(env *e, CC_Array *arr, void *item) {
+    if (cc_array_size(arr) == cc_array_capacity(arr)) {
+        e->heapAllocs++;
+    }
+    cc_array_add(arr, item);
+}
+
+projectileBody createProjectileBody(env *e, const weaponInformation *weaponInfo, const b2Vec2 pos) {
+    b2BodyDef projectileBodyDef = b2DefaultBodyDef();
+    projectileBodyDef.type = b2_dynamicBody;
+    projectileBodyDef.isBullet = weaponInfo->isPhysicsBullet;
+    projectileBodyDef.linearDamping = weaponInfo->damping;
+    projectileBodyDef.enableSleep = weaponInfo->canSleep;
+    projectileBodyDef.position = pos;
+
+    projectileBody body = {.weapon = weaponInfo->type, .sensorID = b2_nullShapeId};
+    body.bodyID = b2CreateBody(e->worldID, &projectileBodyDef);
+    b2ShapeDef projectileShapeDef = b2DefaultShapeDef();
+    projectileShapeDef.enableContactEvents = true;
+    projectileShapeDef.density = weaponInfo->density;
+    projectileShapeDef.restitution = 1.0f;
+    projectileShapeDef.filter.categoryBits = PROJECTILE_SHAPE;
+    projectileShapeDef.filter.maskBits = WALL_SHAPE | FLOATING_WALL_SHAPE | PROJECTILE_SHAPE | DRONE_SHAPE | SHIELD_SHAPE;
+    const b2Circle projectileCircle = {.center = b2Vec2_zero, .radius = weaponInfo->radius};
+    body.shapeID = b2CreateCircleShape(body.bodyID, &projectileShapeDef, &projectileCircle);
+
+    // create a sensor shape if needed
+    if (weaponInfo->proximityDetonates) {
+        body.sensorID = weaponSensor(body.bodyID, weaponInfo->type);
+    }
+
+    return body;
+}
+
+// returns a body for a projectile of the given weapon at pos, reusing
+// a disabled body if one is available
+projectileBody acquireProjectileBody(env *e, const weaponInformation *weaponInfo, const b2Vec2 pos) {
+    projectileBodyList *list = &e->freeProjectileBodies[weaponInfo->type];
+    if (list->size == 0) {
+        return createProjectileBody(e, weaponInfo, pos);
+    }
+
+    const projectileBody body = list->bodies[--list->size];
+    ASSERT(body.weapon == weaponInfo->type);
+    b2Body_SetTransform(body.bodyID, pos, b2Rot_identity);
+    b2Body_SetLinearVelocity(body.bodyID, b2Vec2_zero);
+    b2Body_SetAngularVelocity(body.bodyID, 0.0f);
+    b2Body_Enable(body.bodyID);
+    b2Body_SetAwake(body.bodyID, true);
+    return body;
+}
+
+// disables the body of a destroyed projectile so it can be reused later
+void releaseProjectileBody(env *e, const projectileEntity *projectile) {
+    // mines may be welded to a wall
+    const int numJoints = b2Body_GetJointCount(projectile->bodyID);
+    if (numJoints != 0) {
+        b2JointId joints[numJoints];
+        b2Body_GetJoints(projectile->bodyID, joints, numJoints);
+        for (int i = 0; i < numJoints; i++) {
+            b2DestroyJoint(joints[i]);
+        }
+    }
+
+    // clear user data so events that are still reported for the shapes
+    // are ignored
+    b2Body_SetUserData(projectile->bodyID, NULL);
+    b2Shape_SetUserData(projectile->shapeID, NULL);
+    if (projectile->weaponInfo->proximityDetonates) {
+        b2Shape_SetUserData(projectile->sensorID, NULL);
+    }
+    b2Body_Disable(projectile->bodyID);
+
+    const projectileBody body = {
+        .bodyID = projectile->bodyID,
+        .shapeID = projectile->shapeID,
+        .sensorID = projectile->sensorID,
+        .weapon = projectile->weaponInfo->type,
+    };
+    pushProjectileBody(e, &e->releasedProjectileBodies, &body);
+}
+
+// called every step after contact and sensor events have been handled;
+// bodies released last step are made available for reuse and bodies
+// released this step have to wait until next step
+void recycleProjectileBodies(env *e) {
+    projectileBodyList *cooling = &e->coolingProjectileBodies;
+    for (uint16_t i = 0; i < cooling->size; i++) {
+        const projectileBody *body = &cooling->bodies[i];
+        pushProjectileBody(e, &e->freeProjectileBodies[body->weapon], body);
+    }
+    cooling->size = 0;
+
+    const projectileBodyList released = e->releasedProjectileBodies;
+    e->releasedProjectileBodies = *cooling;
+    *cooling = released;
+}
+
 void createProjectile(env *e, droneEntity *drone, const b2Vec2 normAim) {
     ASSERT_VEC_NORMALIZED(normAim);
 
@@ -871,7 +1162,7 @@ void createProjectile(env *e, droneEntity *drone, const b2Vec2 normAim) {
     if (cellIdx == -1) {
         projectileInWall = true;
     } else {
-        const mapCell *cell = safe_array_get_at(e->cells, cellIdx);
+        const mapCell *cell = &e->cells[cellIdx];
         if (cell->ent != NULL && entityTypeIsWall(cell->ent->type)) {
             projectileInWall = true;
         }
@@ -887,55 +1178,42 @@ void createProjectile(env *e, droneEntity *drone, const b2Vec2 normAim) {
         }
     }
 
-    b2BodyDef projectileBodyDef = b2DefaultBodyDef();
-    projectileBodyDef.type = b2_dynamicBody;
-    projectileBodyDef.isBullet = drone->weaponInfo->isPhysicsBullet;
-    projectileBodyDef.linearDamping = drone->weaponInfo->damping;
-    projectileBodyDef.enableSleep = drone->weaponInfo->canSleep;
-    projectileBodyDef.position = pos;
-    b2BodyId projectileBodyID = b2CreateBody(e->worldID, &projectileBodyDef);
-    b2ShapeDef projectileShapeDef = b2DefaultShapeDef();
-    projectileShapeDef.enableContactEvents = true;
-    projectileShapeDef.density = drone->weaponInfo->density;
-    projectileShapeDef.restitution = 1.0f;
-    projectileShapeDef.filter.categoryBits = PROJECTILE_SHAPE;
-    projectileShapeDef.filter.maskBits = WALL_SHAPE | FLOATING_WALL_SHAPE | PROJECTILE_SHAPE | DRONE_SHAPE | SHIELD_SHAPE;
-    const b2Circle projectileCircle = {.center = b2Vec2_zero, .radius = radius};
-
-    b2ShapeId projectileShapeID = b2CreateCircleShape(projectileBodyID, &projectileShapeDef, &projectileCircle);
+    const projectileBody body = acquireProjectileBody(e, drone->weaponInfo, pos);
+    const b2BodyId projectileBodyID = body.bodyID;
 
     // add a bit of lateral drone velocity to projectile
     b2Vec2 forwardVel = b2MulSV(b2Dot(drone->velocity, normAim), normAim);
     b2Vec2 lateralVel = b2Sub(drone->velocity, forwardVel);
-    lateralVel = b2MulSV(projectileShapeDef.density * DRONE_MOVE_AIM_COEF, lateralVel);
+    lateralVel = b2MulSV(drone->weaponInfo->density * DRONE_MOVE_AIM_COEF, lateralVel);
     b2Vec2 aim = weaponAdjustAim(&e->randState, drone->weaponInfo->type, drone->heat, normAim);
     b2Vec2 fire = b2MulAdd(lateralVel, weaponFire(&e->randState, drone->weaponInfo->type), aim);
     b2Body_ApplyLinearImpulseToCenter(projectileBodyID, fire, true);
 
-    projectileEntity *projectile = fastCalloc(1, sizeof(projectileEntity));
+    projectileEntity *projectile = poolAlloc(&e->projectilePool);
     projectile->droneIdx = drone->idx;
     projectile->bodyID = projectileBodyID;
-    projectile->shapeID = projectileShapeID;
+    projectile->shapeID = body.shapeID;
+    projectile->sensorID = body.sensorID;
     projectile->weaponInfo = drone->weaponInfo;
-    projectile->pos = projectileBodyDef.position;
-    projectile->lastPos = projectileBodyDef.position;
+    projectile->pos = pos;
     projectile->velocity = b2Body_GetLinearVelocity(projectileBodyID);
     projectile->lastVelocity = projectile->velocity;
     projectile->speed = b2Length(projectile->velocity);
     projectile->lastSpeed = projectile->speed;
-    cc_array_add(e->projectiles, projectile);
+    projectile->handle = slotMapInsert(e->projectiles, projectile);
+    setProjectileColumns(e, projectile);
+    if (e->client != NULL) {
+        projectile->trailPoints = poolAlloc(&e->projectileTrailPool);
+    }
 
-    entity *ent = fastCalloc(1, sizeof(entity));
+    entity *ent = poolAlloc(&e->entityPool);
     ent->type = PROJECTILE_ENTITY;
     ent->entity = projectile;
 
     projectile->ent = ent;
     b2Body_SetUserData(projectile->bodyID, ent);
     b2Shape_SetUserData(projectile->shapeID, ent);
-
-    // create a sensor shape if needed
     if (projectile->weaponInfo->proximityDetonates) {
-        projectile->sensorID = weaponSensor(projectile->bodyID, projectile->weaponInfo->type);
         b2Shape_SetUserData(projectile->sensorID, ent);
     }
 }
@@ -971,6 +1249,11 @@ float getShapeProjectedPerimeter(const b2ShapeId shapeID, const b2Vec2 line) {
     return upper - lower;
 }
 
+// returns the width of a box with the given extent projected onto line
+static inline float getBoxProjectedPerimeter(const b2Vec2 extent, const b2Vec2 line) {
+    return 2.0f * ((extent.x * fabsf(line.x)) + (extent.y * fabsf(line.y)));
+}
+
 // explodes projectile and ensures any other projectiles that are caught
 // in the explosion are also destroyed if necessary
 void createProjectileExplosion(env *e, projectileEntity *projectile, const bool initalProjectile) {
@@ -978,7 +1261,12 @@ void createProjectileExplosion(env *e, projectileEntity *projectile, const bool
         return;
     }
     projectile->needsToBeDestroyed = true;
-    cc_array_add(e->explodingProjectiles, projectile);
+    // the initial projectile is destroyed by the caller, only projectiles
+    // caught in the explosion need to be destroyed later so it's not
+    // destroyed twice
+    if (!initalProjectile) {
+        envArrayAdd(e, e->explodingProjectiles, projectile);
+    }
 
     b2ExplosionDef explosion;
     weaponExplosion(projectile->weaponInfo->type, &explosion);
@@ -988,20 +1276,11 @@ void createProjectileExplosion(env *e, projectileEntity *projectile, const bool
     createExplosion(e, parentDrone, projectile, &explosion);
 
     if (e->client != NULL) {
-        explosionInfo *explInfo = fastCalloc(1, sizeof(explosionInfo));
+        explosionInfo *explInfo = poolAlloc(&e->explosionPool);
         explInfo->def = explosion;
         explInfo->renderSteps = UINT16_MAX;
-        cc_array_add(e->explosions, explInfo);
-    }
-    if (!initalProjectile) {
-        return;
+        envArrayAdd(e, e->explosions, explInfo);
     }
-
-    // if we're not destroying the projectiles now, we need to remove the initial projectile
-    // from the list of exploding projectiles so it's not destroyed twice
-    const enum cc_stat res = cc_array_remove_fast(e->explodingProjectiles, projectile, NULL);
-    MAYBE_UNUSED(res);
-    ASSERT(res == CC_OK);
 }
 
 typedef struct explosionCtx {
@@ -1012,16 +1291,8 @@ typedef struct explosionCtx {
     const b2ExplosionDef *def;
 } explosionCtx;
 
-// b2World_Explode doesn't support filtering on shapes of the same category,
-// so we have to do it manually
 // mostly copied from box2d/src/world.c
-bool explodeCallback(b2ShapeId shapeID, void *context) {
-    if (!b2Shape_IsValid(shapeID)) {
-        return true;
-    }
-
-    const explosionCtx *ctx = context;
-    const entity *entity = b2Shape_GetUserData(shapeID);
+static void explodeEntity(const explosionCtx *ctx, const b2ShapeId shapeID, const entity *entity) {
     projectileEntity *projectile = NULL;
     droneEntity *drone = NULL;
     wallEntity *wall = NULL;
@@ -1034,7 +1305,7 @@ bool explodeCallback(b2ShapeId shapeID, void *context) {
         // don't explode the parent projectile
         projectile = entity->entity;
         if (ctx->projectile != NULL && (ctx->projectile == projectile || projectile->needsToBeDestroyed)) {
-            return true;
+            return;
         }
         transform.p = projectile->pos;
         transform.q = b2Rot_identity;
@@ -1044,7 +1315,7 @@ bool explodeCallback(b2ShapeId shapeID, void *context) {
         // the explosion shouldn't affect the parent drone if this is a burst
         if (drone->idx == ctx->parentDrone->idx) {
             if (ctx->isBurst) {
-                return true;
+                return;
             }
 
             drone->stepInfo.ownShotTaken = true;
@@ -1073,7 +1344,7 @@ bool explodeCallback(b2ShapeId shapeID, void *context) {
         isFloatingWall = wall->isFloating;
         // normal explosions don't affect static walls
         if (!ctx->isBurst && isStaticWall) {
-            return true;
+            return;
         }
         transform.p = wall->pos;
         transform.q = wall->rot;
@@ -1099,7 +1370,7 @@ bool explodeCallback(b2ShapeId shapeID, void *context) {
     // don't consider falloff for static walls so burst pushback isn't as
     // surprising to players
     if (output.distance > ctx->def->radius + ctx->def->falloff || (isStaticWall && output.distance > ctx->def->radius)) {
-        return true;
+        return;
     }
 
     // don't explode the entity if it's behind a static or floating wall,
@@ -1110,7 +1381,7 @@ bool explodeCallback(b2ShapeId shapeID, void *context) {
         filter.maskBits |= FLOATING_WALL_SHAPE;
     }
     if (!isStaticWall && posBehindWall(ctx->e, ctx->def->position, output.pointA, entity, filter, NULL)) {
-        return true;
+        return;
     }
 
     const b2Vec2 closestPoint = output.pointA;
@@ -1133,7 +1404,12 @@ bool explodeCallback(b2ShapeId shapeID, void *context) {
         // the localLine isn't used in perimeter calculations for circles
         localLine = b2InvRotateVector(transform.q, b2LeftPerp(direction));
     }
-    float perimeter = getShapeProjectedPerimeter(shapeID, localLine);
+    float perimeter;
+    if (wall != NULL) {
+        perimeter = getBoxProjectedPerimeter(wall->extent, localLine);
+    } else {
+        perimeter = getShapeProjectedPerimeter(shapeID, localLine);
+    }
     float scale = 1.0f;
     // scale the impulse magnitude down is the entity is outside the
     // radius and inside the falloff
@@ -1247,7 +1523,36 @@ bool explodeCallback(b2ShapeId shapeID, void *context) {
             ERRORF("unknown entity type for burst impulse %d", entity->type);
         }
     }
+}
+
+// b2World_Explode doesn't support filtering on shapes of the same category,
+// so we have to do it manually
+bool explodeCallback(b2ShapeId shapeID, void *context) {
+    if (!b2Shape_IsValid(shapeID)) {
+        return true;
+    }
+
+    const explosionCtx *ctx = context;
+    const entity *ent = b2Shape_GetUserData(shapeID);
+    if (entityTypeIsWall(ent->type)) {
+        // explode the wall of each cell a merged wall covers separately
+        // so bursting off of static walls isn't affected by how they
+        // were merged
+        const wallEntity *wall = ent->entity;
+        if (wall->mergedColumns != 0) {
+            const uint8_t columns = ctx->e->map->columns;
+            for (uint8_t row = 0; row < wall->mergedRows; row++) {
+                for (uint8_t col = 0; col < wall->mergedColumns; col++) {
+                    const mapCell *cell = &ctx->e->cells[wall->mapCellIdx + col + (row * columns)];
+                    ASSERT(cell->ent != NULL && entityTypeIsWall(cell->ent->type));
+                    explodeEntity(ctx, shapeID, cell->ent);
+                }
+            }
+            return true;
+        }
+    }
 
+    explodeEntity(ctx, shapeID, ent);
     return true;
 }
 
@@ -1280,19 +1585,22 @@ void destroyProjectile(env *e, projectileEntity *projectile, const bool processE
         createProjectileExplosion(e, projectile, true);
     }
 
-    fastFree(projectile->ent);
+    poolFree(&e->entityPool, projectile->ent);
 
-    b2DestroyBody(projectile->bodyID);
+    releaseProjectileBody(e, projectile);
 
     if (full) {
-        enum cc_stat res = cc_array_remove_fast(e->projectiles, projectile, NULL);
-        MAYBE_UNUSED(res);
-        ASSERT(res == CC_OK);
+        const bool removed = slotMapRemove(e->projectiles, projectile->handle);
+        ASSERT(removed);
+        MAYBE_UNUSED(removed);
     }
 
-    e->stats[projectile->droneIdx].shotDistances[projectile->droneIdx] += projectile->distance;
+    e->stats[projectile->droneIdx].shotDistances[projectile->droneIdx] += projectileDistance(e, projectile);
 
-    fastFree(projectile);
+    if (projectile->trailPoints != NULL) {
+        poolFree(&e->projectileTrailPool, projectile->trailPoints);
+    }
+    poolFree(&e->projectilePool, projectile);
 }
 
 // destroy projectiles that were caught in an explosion; projectiles
@@ -1307,10 +1615,7 @@ static inline void destroyExplodedProjectiles(env *e) {
     cc_array_iter_init(&iter, e->explodingProjectiles);
     projectileEntity *projectile;
     while (cc_array_iter_next(&iter, (void **)&projectile) != CC_ITER_END) {
-        destroyProjectile(e, projectile, false, false);
-        const enum cc_stat res = cc_array_remove_fast(e->projectiles, projectile, NULL);
-        MAYBE_UNUSED(res);
-        ASSERT(res == CC_OK);
+        destroyProjectile(e, projectile, false, true);
     }
     cc_array_remove_all(e->explodingProjectiles);
 }
@@ -1340,7 +1645,7 @@ void createSuddenDeathWalls(env *e, const b2Vec2 startPos, const b2Vec2 size) {
         ERRORF("invalid position for sudden death wall: (%f, %f)", startPos.x, startPos.y);
     }
     for (uint16_t i = startIdx; i <= endIdx; i += indexIncrement) {
-        mapCell *cell = safe_array_get_at(e->cells, i);
+        mapCell *cell = &e->cells[i];
         if (cell->ent != NULL) {
             if (cell->ent->type == WEAPON_PICKUP_ENTITY) {
                 weaponPickupEntity *pickup = cell->ent->entity;
@@ -1430,16 +1735,14 @@ void handleSuddenDeath(env *e) {
 
     // make floating walls static bodies if they are now overlapping with
     // a newly placed wall, but destroy them if they are fully inside a wall
-    CC_ArrayIter floatingWallIter;
-    cc_array_iter_init(&floatingWallIter, e->floatingWalls);
+    slotMapIter floatingWallIter;
+    slotMapIterInit(&floatingWallIter, e->floatingWalls);
     wallEntity *wall;
-    while (cc_array_iter_next(&floatingWallIter, (void **)&wall) != CC_ITER_END) {
-        const mapCell *cell = safe_array_get_at(e->cells, wall->mapCellIdx);
+    while (slotMapIterNext(&floatingWallIter, (void **)&wall)) {
+        const mapCell *cell = &e->cells[wall->mapCellIdx];
         if (cell->ent != NULL && entityTypeIsWall(cell->ent->type)) {
             // floating wall is overlapping with a wall, destroy it
-            const enum cc_stat res = cc_array_iter_remove_fast(&floatingWallIter, NULL);
-            MAYBE_UNUSED(res);
-            ASSERT(res == CC_OK);
+            slotMapIterRemove(&floatingWallIter);
 
             const b2Vec2 wallPos = wall->pos;
             MAYBE_UNUSED(wallPos);
@@ -1450,13 +1753,13 @@ void handleSuddenDeath(env *e) {
     }
 
     // detroy all projectiles that are now overlapping with a newly placed wall
-    CC_ArrayIter projectileIter;
-    cc_array_iter_init(&projectileIter, e->projectiles);
+    slotMapIter projectileIter;
+    slotMapIterInit(&projectileIter, e->projectiles);
     projectileEntity *projectile;
-    while (cc_array_iter_next(&projectileIter, (void **)&projectile) != CC_ITER_END) {
-        const mapCell *cell = safe_array_get_at(e->cells, projectile->mapCellIdx);
+    while (slotMapIterNext(&projectileIter, (void **)&projectile)) {
+        const mapCell *cell = &e->cells[projectile->mapCellIdx];
         if (cell->ent != NULL && entityTypeIsWall(cell->ent->type)) {
-            cc_array_iter_remove_fast(&projectileIter, NULL);
+            slotMapIterRemove(&projectileIter);
             destroyProjectile(e, projectile, false, false);
         }
     }
@@ -1566,10 +1869,10 @@ void droneBrake(env *e, droneEntity *drone, const bool brake) {
     }
 
     if (e->client != NULL) {
-        brakeTrailPoint *trailPoint = fastCalloc(1, sizeof(brakeTrailPoint));
+        brakeTrailPoint *trailPoint = poolAlloc(&e->trailPointPool);
         trailPoint->pos = drone->pos;
         trailPoint->lifetime = UINT16_MAX;
-        cc_array_add(e->brakeTrailPoints, trailPoint);
+        envArrayAdd(e, e->brakeTrailPoints, trailPoint);
     }
 }
 
@@ -1622,12 +1925,12 @@ void droneBurst(env *e, droneEntity *drone) {
     e->stats[drone->idx].totalBursts++;
 
     if (e->client != NULL) {
-        explosionInfo *explInfo = fastCalloc(1, sizeof(explosionInfo));
+        explosionInfo *explInfo = poolAlloc(&e->explosionPool);
         explInfo->def = explosion;
         explInfo->isBurst = true;
         explInfo->droneIdx = drone->idx;
         explInfo->renderSteps = UINT16_MAX;
-        cc_array_add(e->explosions, explInfo);
+        envArrayAdd(e, e->explosions, explInfo);
     }
 }
 
@@ -1729,17 +2032,39 @@ bool droneStep(env *e, droneEntity *drone) {
     return true;
 }
 
+// accumulates the distance traveled of every projectile and flags ones
+// that traveled past their max distance; this runs over every used slot
+// including free ones so it can be vectorized, free slots are reset
+// when they are reused
+static inline void updateProjectileDistances(env *e) {
+    projectileColumns *cols = &e->projectileCols;
+    const float *restrict posX = cols->posX;
+    const float *restrict posY = cols->posY;
+    const float *restrict lastPosX = cols->lastPosX;
+    const float *restrict lastPosY = cols->lastPosY;
+    const float *restrict maxDistance = cols->maxDistance;
+    float *restrict distance = cols->distance;
+    uint8_t *restrict expired = cols->expired;
+
+    const uint16_t numSlots = e->projectiles->usedSlots;
+    for (uint16_t i = 0; i < numSlots; i++) {
+        const float dx = posX[i] - lastPosX[i];
+        const float dy = posY[i] - lastPosY[i];
+        distance[i] += sqrtf((dx * dx) + (dy * dy));
+        expired[i] = distance[i] >= maxDistance[i];
+    }
+}
+
 void projectilesStep(env *e) {
-    CC_ArrayIter iter;
-    cc_array_iter_init(&iter, e->projectiles);
+    updateProjectileDistances(e);
+
+    slotMapIter iter;
+    slotMapIterInit(&iter, e->projectiles);
     projectileEntity *projectile;
-    while (cc_array_iter_next(&iter, (void **)&projectile) != CC_ITER_END) {
+    while (slotMapIterNext(&iter, (void **)&projectile)) {
         if (projectile->needsToBeDestroyed) {
             continue;
         }
-        const float maxDistance = projectile->weaponInfo->maxDistance;
-        const float distance = b2Distance(projectile->pos, projectile->lastPos);
-        projectile->distance += distance;
 
         // if a drone is in a set mine's sensor range but behind a wall,
         // we need to check until the drone leaves the sensor range if
@@ -1758,10 +2083,8 @@ void projectilesStep(env *e) {
 
                 // we have to destroy the projectile using the iterator so
                 // we can continue to iterate correctly
+                slotMapIterRemove(&iter);
                 destroyProjectile(e, projectile, true, false);
-                enum cc_stat res = cc_array_iter_remove_fast(&iter, NULL);
-                MAYBE_UNUSED(res);
-                ASSERT(res == CC_OK);
                 destroyed = true;
                 break;
             }
@@ -1770,17 +2093,11 @@ void projectilesStep(env *e) {
             }
         }
 
-        if (maxDistance == INFINITE) {
-            continue;
-        }
-
-        if (projectile->distance >= maxDistance) {
+        if (e->projectileCols.expired[projectileCol(projectile)]) {
             // we have to destroy the projectile using the iterator so
             // we can continue to iterate correctly
+            slotMapIterRemove(&iter);
             destroyProjectile(e, projectile, true, false);
-            enum cc_stat res = cc_array_iter_remove_fast(&iter, NULL);
-            MAYBE_UNUSED(res);
-            ASSERT(res == CC_OK);
             continue;
         }
     }
@@ -1789,13 +2106,13 @@ void projectilesStep(env *e) {
 }
 
 void weaponPickupsStep(env *e) {
-    CC_ArrayIter iter;
-    cc_array_iter_init(&iter, e->pickups);
+    slotMapIter iter;
+    slotMapIterInit(&iter, e->pickups);
     weaponPickupEntity *pickup;
 
     // respawn weapon pickups at a random location as a random weapon type
     // once the respawn wait has elapsed
-    while (cc_array_iter_next(&iter, (void **)&pickup) != CC_ITER_END) {
+    while (slotMapIterNext(&iter, (void **)&pickup)) {
         if (pickup->respawnWait == 0.0f) {
             continue;
         }
@@ -1806,9 +2123,7 @@ void weaponPickupsStep(env *e) {
 
         b2Vec2 pos;
         if (!findOpenPos(e, WEAPON_PICKUP_SHAPE, &pos, -1)) {
-            const enum cc_stat res = cc_array_iter_remove_fast(&iter, NULL);
-            MAYBE_UNUSED(res);
-            ASSERT(res == CC_OK);
+            slotMapIterRemove(&iter);
             DEBUG_LOG("destroying weapon pickup");
             destroyWeaponPickup(e, pickup);
             continue;
@@ -1822,9 +2137,18 @@ void weaponPickupsStep(env *e) {
         }
         DEBUG_LOGF("respawned weapon pickup at cell %d (%f, %f)", cellIdx, pos.x, pos.y);
         pickup->mapCellIdx = cellIdx;
-        createWeaponPickupBodyShape(e, pickup);
+        // touch events were ignored while waiting to respawn, and the
+        // new body or position starts out touching nothing; floating
+        // walls overlapping the new position will send begin touch events
+        pickup->floatingWallsTouching = 0;
+        if (pickup->bodyDestroyed) {
+            createWeaponPickupBodyShape(e, pickup);
+        } else {
+            b2Body_SetTransform(pickup->bodyID, pos, b2Rot_identity);
+            b2Body_Enable(pickup->bodyID);
+        }
 
-        mapCell *cell = safe_array_get_at(e->cells, cellIdx);
+        mapCell *cell = &e->cells[cellIdx];
         cell->ent = pickup->ent;
     }
 }
@@ -1861,7 +2185,9 @@ void handleBodyMoveEvents(env *e) {
             wall->mapCellIdx = entityPosToCellIdx(e, newPos);
             if (wall->mapCellIdx == -1) {
                 DEBUG_LOGF("invalid position for floating wall: (%f, %f) destroying", newPos.x, newPos.y);
-                cc_array_remove_fast(e->floatingWalls, wall, NULL);
+                const bool removed = slotMapRemove(e->floatingWalls, wall->handle);
+                ASSERT(removed);
+                MAYBE_UNUSED(removed);
                 destroyWall(e, wall, false);
                 continue;
             }
@@ -1877,8 +2203,7 @@ void handleBodyMoveEvents(env *e) {
                 destroyProjectile(e, proj, false, true);
                 continue;
             }
-            proj->lastPos = proj->pos;
-            proj->pos = newPos;
+            setProjectilePos(e, proj, newPos);
             proj->lastVelocity = proj->velocity;
             proj->velocity = b2Body_GetLinearVelocity(proj->bodyID);
             // if the projectile doesn't have damping its speed will
@@ -1890,8 +2215,8 @@ void handleBodyMoveEvents(env *e) {
                 proj->speed = b2Length(proj->velocity);
             }
 
-            if (e->client != NULL) {
-                updateTrailPoints(e, &proj->trailPoints, MAX_PROJECTLE_TRAIL_POINTS, newPos);
+            if (e->client != NULL && proj->trailPoints != NULL) {
+                updateTrailPoints(e, proj->trailPoints, MAX_PROJECTLE_TRAIL_POINTS, newPos);
             }
             break;
         case DRONE_ENTITY:
@@ -2102,13 +2427,13 @@ void handleContactEvents(env *e) {
         entity *e1 = NULL;
         entity *e2 = NULL;
 
+        // user data will be NULL if a shape belongs to a released
+        // projectile body
         if (b2Shape_IsValid(event->shapeIdA)) {
             e1 = b2Shape_GetUserData(event->shapeIdA);
-            ASSERT(e1 != NULL);
         }
         if (b2Shape_IsValid(event->shapeIdB)) {
             e2 = b2Shape_GetUserData(event->shapeIdB);
-            ASSERT(e2 != NULL);
         }
 
         if (e1 != NULL) {
@@ -2154,11 +2479,9 @@ void handleContactEvents(env *e) {
         entity *e2 = NULL;
         if (b2Shape_IsValid(event->shapeIdA)) {
             e1 = b2Shape_GetUserData(event->shapeIdA);
-            ASSERT(e1 != NULL);
         }
         if (b2Shape_IsValid(event->shapeIdB)) {
             e2 = b2Shape_GetUserData(event->shapeIdB);
-            ASSERT(e2 != NULL);
         }
         if (e1 != NULL && e1->type == PROJECTILE_ENTITY) {
             handleProjectileEndContact(e1, e2);
@@ -2173,7 +2496,9 @@ void handleContactEvents(env *e) {
 // mark the pickup as disabled if a floating wall is touching it
 void handleWeaponPickupBeginTouch(env *e, const entity *sensor, entity *visitor) {
     weaponPickupEntity *pickup = sensor->entity;
-    if (pickup->floatingWallsTouching != 0) {
+    // the pickup may have been disabled earlier this step, its shape
+    // is still valid if its body is only disabled
+    if (pickup->floatingWallsTouching != 0 || pickup->respawnWait != 0.0f) {
         return;
     }
 
@@ -2215,7 +2540,7 @@ void handleProjectileBeginTouch(env *e, const entity *sensor, const entity *visi
 
     switch (projectile->weaponInfo->type) {
     case FLAK_CANNON_WEAPON:
-        if (projectile->distance < FLAK_CANNON_SAFE_DISTANCE) {
+        if (projectileDistance(e, projectile) < FLAK_CANNON_SAFE_DISTANCE) {
             return;
         }
         destroyProjectile(e, projectile, true, true);
@@ -2263,7 +2588,10 @@ void handleWeaponPickupEndTouch(const entity *sensor, entity *visitor) {
             return;
         }
 
-        pickup->floatingWallsTouching--;
+        // the end touch may be from before the pickup was respawned
+        if (pickup->floatingWallsTouching != 0) {
+            pickup->floatingWallsTouching--;
+        }
         break;
     default:
         ERRORF("invalid weapon pickup end touch visitor %d", visitor->type);
@@ -2287,14 +2615,19 @@ void handleSensorEvents(env *e) {
             continue;
         }
         entity *s = b2Shape_GetUserData(event->sensorShapeId);
-        ASSERT(s != NULL);
+        if (s == NULL) {
+            // the sensor belongs to a released projectile body
+            continue;
+        }
 
         if (!b2Shape_IsValid(event->visitorShapeId)) {
             DEBUG_LOG("could not find visitor shape for begin touch event");
             continue;
         }
         entity *v = b2Shape_GetUserData(event->visitorShapeId);
-        ASSERT(v != NULL);
+        if (v == NULL) {
+            continue;
+        }
 
         switch (s->type) {
         case WEAPON_PICKUP_ENTITY:
@@ -2315,7 +2648,10 @@ void handleSensorEvents(env *e) {
             continue;
         }
         entity *s = b2Shape_GetUserData(event->sensorShapeId);
-        ASSERT(s != NULL);
+        if (s == NULL) {
+            // the sensor belongs to a released projectile body
+            continue;
+        }
         if (s->type == PROJECTILE_ENTITY) {
             handleProjectileEndTouch(s);
             continue;
@@ -2326,7 +2662,9 @@ void handleSensorEvents(env *e) {
             continue;
         }
         entity *v = b2Shape_GetUserData(event->visitorShapeId);
-        ASSERT(v != NULL);
+        if (v == NULL) {
+            continue;
+        }
 
         handleWeaponPickupEndTouch(s, v);
     }
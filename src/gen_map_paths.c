@@ -0,0 +1,21 @@
+#include "env.h"
+#include "tool_env.h"
+
+// precomputes the scripted agent paths of every map and saves them to a
+// file that the Python module memory maps at runtime
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <output file>\n", argv[0]);
+        return 1;
+    }
+
+    toolEnv t = createToolEnv(2, 2, -1, 0, false, true);
+    initMaps(t.e);
+
+    saveMapPaths(argv[1]);
+
+    destroyToolEnv(&t);
+    destroyMaps();
+
+    return 0;
+}
@@ -112,14 +112,18 @@
 // use malloc when debugging so the address sanitizer can find issues with
 // heap memory, use dlmalloc in release mode for performance; emscripten
 // uses dlmalloc by default so no need to change anything here
-#if !defined(NDEBUG) || defined(__EMSCRIPTEN__)
+// dlmalloc isn't thread safe, so use the system allocator if envs may be
+// stepped from multiple threads, glibc's per-thread arenas scale well
+#if !defined(NDEBUG) || defined(__EMSCRIPTEN__) || defined(MULTITHREADED)
 #define fastMalloc(size) malloc(size)
 #define fastCalloc(nmemb, size) calloc(nmemb, size)
+#define fastRealloc(ptr, size) realloc(ptr, size)
 #define fastFree(ptr) free(ptr)
 #else
 #include "include/dlmalloc.h"
 #define fastMalloc(size) dlmalloc(size)
 #define fastCalloc(nmemb, size) dlcalloc(nmemb, size)
+#define fastRealloc(ptr, size) dlrealloc(ptr, size)
 #define fastFree(ptr) dlfree(ptr)
 #endif
 
@@ -137,6 +141,23 @@ static inline bool b2VecEqual(const b2Vec2 v1, const b2Vec2 v2) {
     return v1.x == v2.x && v1.y == v2.y;
 }
 
+#ifndef AUTOPXD
+static inline uint64_t nowNs() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+// hints to the CPU that the thread is busy waiting
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#define CPU_RELAX()
+#endif
+
 #ifndef AUTOPXD
 // from https://lemire.me/blog/2019/03/19/the-fastest-conventional-random-number-generator-that-can-pass-big-crush/
 // see also https://github.com/lemire/testingRNG
@@ -0,0 +1,160 @@
+#ifndef IMPULSE_WARS_LOG_STATS_H
+#define IMPULSE_WARS_LOG_STATS_H
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// streaming statistics that take constant memory no matter how many
+// values are added, and that can be merged so stats gathered by
+// different threads can be combined
+
+// running mean and variance using Welford's algorithm
+typedef struct runningStat {
+    double mean;
+    // sum of squared differences from the mean
+    double m2;
+} runningStat;
+
+// count is the number of values added including this one
+static inline void runningStatAdd(runningStat *stat, const uint32_t count, const double value) {
+    const double delta = value - stat->mean;
+    stat->mean += delta / count;
+    stat->m2 += delta * (value - stat->mean);
+}
+
+// merges src into dst using Chan et al's parallel algorithm
+static inline void runningStatMerge(runningStat *dst, const uint32_t dstCount, const runningStat *src, const uint32_t srcCount) {
+    if (srcCount == 0) {
+        return;
+    }
+    if (dstCount == 0) {
+        *dst = *src;
+        return;
+    }
+
+    const double count = (double)dstCount + srcCount;
+    const double delta = src->mean - dst->mean;
+    dst->mean += delta * (srcCount / count);
+    dst->m2 += src->m2 + (delta * delta * ((double)dstCount * srcCount / count));
+}
+
+// sample standard deviation
+static inline double runningStatStddev(const runningStat *stat, const uint32_t count) {
+    if (count < 2) {
+        return 0.0;
+    }
+    return sqrt(fmax(stat->m2, 0.0) / (count - 1));
+}
+
+// a log-linear histogram for estimating quantiles: every power of 2 is
+// split into equally sized buckets, so estimates have a bounded relative
+// error; values of either sign are supported and buckets are ordered by
+// value so quantiles can be found with a single scan
+#define SKETCH_SUB_BUCKET_BITS 3
+#define SKETCH_SUB_BUCKETS (1 << SKETCH_SUB_BUCKET_BITS)
+// values with a magnitude smaller than 2^SKETCH_MIN_EXP are counted as 0,
+// values with a magnitude of 2^SKETCH_MAX_EXP or more are clamped
+#define SKETCH_MIN_EXP -10
+#define SKETCH_MAX_EXP 22
+#define SKETCH_MAG_BUCKETS ((SKETCH_MAX_EXP - SKETCH_MIN_EXP) * SKETCH_SUB_BUCKETS)
+#define SKETCH_BUCKETS ((2 * SKETCH_MAG_BUCKETS) + 1)
+
+typedef struct quantileSketch {
+    uint32_t count;
+    float min;
+    float max;
+    uint32_t buckets[SKETCH_BUCKETS];
+} quantileSketch;
+
+static inline void initQuantileSketch(quantileSketch *sketch) {
+    memset(sketch, 0x0, sizeof(quantileSketch));
+    sketch->min = FLT_MAX;
+    sketch->max = -FLT_MAX;
+}
+
+// negative values are stored below the zero bucket with larger
+// magnitudes first, positive values above it with larger magnitudes last
+static inline uint16_t sketchBucket(const float value) {
+    const float magnitude = fabsf(value);
+    // also catches NaNs
+    if (!(magnitude >= ldexpf(1.0f, SKETCH_MIN_EXP))) {
+        return SKETCH_MAG_BUCKETS;
+    }
+
+    int exp = SKETCH_MAX_EXP + 1;
+    float fraction = 0.5f;
+    if (isfinite(magnitude)) {
+        // magnitude = fraction * 2^exp, fraction is in [0.5, 1)
+        fraction = frexpf(magnitude, &exp);
+    }
+    int32_t octave = exp - 1 - SKETCH_MIN_EXP;
+    int32_t subBucket = (int32_t)(((fraction * 2.0f) - 1.0f) * SKETCH_SUB_BUCKETS);
+    if (octave >= SKETCH_MAX_EXP - SKETCH_MIN_EXP) {
+        octave = SKETCH_MAX_EXP - SKETCH_MIN_EXP - 1;
+        subBucket = SKETCH_SUB_BUCKETS - 1;
+    }
+    const uint16_t magBucket = (octave << SKETCH_SUB_BUCKET_BITS) + subBucket;
+
+    if (value < 0.0f) {
+        return SKETCH_MAG_BUCKETS - 1 - magBucket;
+    }
+    return SKETCH_MAG_BUCKETS + 1 + magBucket;
+}
+
+// returns the value in the middle of a bucket
+static inline float sketchBucketValue(const uint16_t bucket) {
+    if (bucket == SKETCH_MAG_BUCKETS) {
+        return 0.0f;
+    }
+
+    float sign = 1.0f;
+    uint16_t magBucket = bucket - SKETCH_MAG_BUCKETS - 1;
+    if (bucket < SKETCH_MAG_BUCKETS) {
+        sign = -1.0f;
+        magBucket = SKETCH_MAG_BUCKETS - 1 - bucket;
+    }
+    const int32_t octave = magBucket >> SKETCH_SUB_BUCKET_BITS;
+    const int32_t subBucket = magBucket & (SKETCH_SUB_BUCKETS - 1);
+    const float fraction = 1.0f + ((subBucket + 0.5f) / SKETCH_SUB_BUCKETS);
+    return sign * ldexpf(fraction, octave + SKETCH_MIN_EXP);
+}
+
+static inline void quantileSketchAdd(quantileSketch *sketch, const float value) {
+    sketch->count++;
+    sketch->min = fminf(sketch->min, value);
+    sketch->max = fmaxf(sketch->max, value);
+    sketch->buckets[sketchBucket(value)]++;
+}
+
+static inline void quantileSketchMerge(quantileSketch *dst, const quantileSketch *src) {
+    if (src->count == 0) {
+        return;
+    }
+    dst->count += src->count;
+    dst->min = fminf(dst->min, src->min);
+    dst->max = fmaxf(dst->max, src->max);
+    for (uint16_t i = 0; i < SKETCH_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+}
+
+// estimates the value at quantile q, which should be between 0 and 1
+static inline float quantileSketchQuantile(const quantileSketch *sketch, const float q) {
+    if (sketch->count == 0) {
+        return 0.0f;
+    }
+
+    const uint32_t rank = (uint32_t)ceilf(q * sketch->count);
+    uint32_t seen = 0;
+    for (uint16_t i = 0; i < SKETCH_BUCKETS; i++) {
+        seen += sketch->buckets[i];
+        if (seen != 0 && seen >= rank) {
+            return fminf(fmaxf(sketchBucketValue(i), sketch->min), sketch->max);
+        }
+    }
+    return sketch->max;
+}
+
+#endif
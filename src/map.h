@@ -4,6 +4,13 @@
 #include <errno.h>
 #include <string.h>
 
+#ifndef AUTOPXD
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "env.h"
 #include "settings.h"
 
@@ -357,8 +364,7 @@ mapEntry *maps[] = {
 };
 #endif
 
-void resetMap(env *e) {
-    // if sudden death walls were placed, remove them
+void removeSuddenDeathWalls(env *e) {
     if (e->suddenDeathWallsPlaced) {
         e->suddenDeathWallsPlaced = false;
         DEBUG_LOG("removing sudden death walls");
@@ -374,8 +380,10 @@ void resetMap(env *e) {
             destroyWall(e, wall, true);
         }
     }
+}
 
-    // place floating walls with a set position if there are any
+// place floating walls with a set position if there are any
+void placeSetFloatingWalls(env *e) {
     const mapEntry *map = maps[e->mapIdx];
     if (!map->hasSetFloatingWalls) {
         return;
@@ -407,13 +415,94 @@ void resetMap(env *e) {
                 continue;
             }
 
-            const mapCell *cell = safe_array_get_at(e->cells, cellIdx);
+            const mapCell *cell = &e->cells[cellIdx];
             createWall(e, cell->pos, FLOATING_WALL_THICKNESS, FLOATING_WALL_THICKNESS, cellIdx, wallType, true);
             cellIdx++;
         }
     }
 }
 
+void resetMap(env *e) {
+    removeSuddenDeathWalls(e);
+    placeSetFloatingWalls(e);
+}
+
+// set the positions of the current map's cells and mark them all empty
+void resetMapCells(env *e) {
+    const uint8_t columns = e->map->columns;
+    const uint8_t rows = e->map->rows;
+    for (int row = 0; row < rows; row++) {
+        for (int col = 0; col < columns; col++) {
+            const float x = (col - ((columns - 1) * 0.5f)) * WALL_THICKNESS;
+            const float y = (row - (rows - 1) * 0.5f) * WALL_THICKNESS;
+            mapCell *cell = &e->cells[col + (row * columns)];
+            cell->ent = NULL;
+            cell->pos = (b2Vec2){.x = x, .y = y};
+        }
+    }
+}
+
+// greedily covers the static walls of the current map with as few
+// boxes of the same wall type as possible, extending each box right and
+// then down from the first uncovered cell; every static wall cell still
+// gets its own wall, created in cell order so indexes into env.walls
+// match the precomputed nearest walls of the map
+void mergeStaticWalls(env *e, const int8_t *staticWallTypes) {
+    const uint8_t columns = e->map->columns;
+    const uint8_t rows = e->map->rows;
+    wallEntity *cellMergedWalls[e->numCells];
+    memset(cellMergedWalls, 0x0, sizeof(cellMergedWalls));
+
+    for (uint16_t cellIdx = 0; cellIdx < e->numCells; cellIdx++) {
+        const int8_t wallType = staticWallTypes[cellIdx];
+        if (wallType == -1 || cellMergedWalls[cellIdx] != NULL) {
+            continue;
+        }
+        const uint8_t startCol = cellIdx % columns;
+        const uint8_t startRow = cellIdx / columns;
+
+        uint8_t mergedColumns = 1;
+        while (startCol + mergedColumns < columns) {
+            const uint16_t idx = cellIdx + mergedColumns;
+            if (staticWallTypes[idx] != wallType || cellMergedWalls[idx] != NULL) {
+                break;
+            }
+            mergedColumns++;
+        }
+
+        uint8_t mergedRows = 1;
+        while (startRow + mergedRows < rows) {
+            bool rowMatches = true;
+            for (uint8_t col = 0; col < mergedColumns; col++) {
+                const uint16_t idx = cellIdx + col + (mergedRows * columns);
+                if (staticWallTypes[idx] != wallType || cellMergedWalls[idx] != NULL) {
+                    rowMatches = false;
+                    break;
+                }
+            }
+            if (!rowMatches) {
+                break;
+            }
+            mergedRows++;
+        }
+
+        wallEntity *merged = createMergedWall(e, cellIdx, mergedColumns, mergedRows, wallType);
+        for (uint8_t row = 0; row < mergedRows; row++) {
+            for (uint8_t col = 0; col < mergedColumns; col++) {
+                cellMergedWalls[cellIdx + col + (row * columns)] = merged;
+            }
+        }
+    }
+
+    for (uint16_t cellIdx = 0; cellIdx < e->numCells; cellIdx++) {
+        if (cellMergedWalls[cellIdx] == NULL) {
+            continue;
+        }
+        e->cells[cellIdx].ent = createCellWall(e, cellMergedWalls[cellIdx], cellIdx);
+    }
+    DEBUG_LOGF("merged %zu static walls into %zu boxes", cc_array_size(e->walls), cc_array_size(e->mergedWalls));
+}
+
 void setupMap(env *e, const uint8_t mapIdx) {
     // reset the map if we're switching to the same map
     if (e->mapIdx == mapIdx) {
@@ -421,45 +510,67 @@ void setupMap(env *e, const uint8_t mapIdx) {
         return;
     }
 
-    // clear the old map
-    for (size_t i = 0; i < cc_array_size(e->walls); i++) {
-        wallEntity *wall = safe_array_get_at(e->walls, i);
-        destroyWall(e, wall, false);
-    }
-
-    for (size_t i = 0; i < cc_array_size(e->cells); i++) {
-        mapCell *cell = safe_array_get_at(e->cells, i);
-        fastFree(cell);
+    // static walls of every map that has been used are kept, disable
+    // the old map's walls so they can be re-enabled if it's used again
+    if (e->walls != NULL) {
+        removeSuddenDeathWalls(e);
+        for (size_t i = 0; i < cc_array_size(e->mergedWalls); i++) {
+            const wallEntity *wall = safe_array_get_at(e->mergedWalls, i);
+            b2Body_Disable(wall->bodyID);
+        }
     }
-
-    cc_array_remove_all(e->walls);
-    cc_array_remove_all(e->cells);
     e->suddenDeathWallsPlaced = false;
 
     const uint8_t columns = maps[mapIdx]->columns;
     const uint8_t rows = maps[mapIdx]->rows;
     const char *layout = maps[mapIdx]->layout;
+    ASSERTF(columns * rows < MAX_CELLS, "map %d has too many cells: %d", mapIdx, columns * rows);
 
     e->mapIdx = mapIdx;
+    e->numCells = columns * rows;
     e->map = maps[mapIdx];
-    e->defaultWeapon = weaponInfos[maps[mapIdx]->defaultWeapon];
-    if (e->isTraining && randFloat(&e->randState, 0.0f, 1.0f) < 0.25f) {
-        e->defaultWeapon = weaponInfos[randInt(&e->randState, 0, NUM_WEAPONS - 1)];
+    if (e->pinnedDefaultWeapon != -1) {
+        e->defaultWeapon = weaponInfos[e->pinnedDefaultWeapon];
+    } else {
+        e->defaultWeapon = weaponInfos[maps[mapIdx]->defaultWeapon];
+        if (e->isTraining && randFloat(&e->randState, 0.0f, 1.0f) < 0.25f) {
+            e->defaultWeapon = weaponInfos[randInt(&e->randState, 0, NUM_WEAPONS - 1)];
+        }
     }
 
+    resetMapCells(e);
+
+    if (e->mapWalls[mapIdx] != NULL) {
+        e->walls = e->mapWalls[mapIdx];
+        e->mergedWalls = e->mapMergedWalls[mapIdx];
+        for (size_t i = 0; i < cc_array_size(e->mergedWalls); i++) {
+            const wallEntity *wall = safe_array_get_at(e->mergedWalls, i);
+            b2Body_Enable(wall->bodyID);
+        }
+        for (size_t i = 0; i < cc_array_size(e->walls); i++) {
+            const wallEntity *wall = safe_array_get_at(e->walls, i);
+            e->cells[wall->mapCellIdx].ent = wall->ent;
+        }
+        placeSetFloatingWalls(e);
+        return;
+    }
+
+    cc_array_new(&e->mapWalls[mapIdx]);
+    e->walls = e->mapWalls[mapIdx];
+    cc_array_new(&e->mapMergedWalls[mapIdx]);
+    e->mergedWalls = e->mapMergedWalls[mapIdx];
+
+    // wall type of each static wall cell, -1 if there is no static wall
+    int8_t staticWallTypes[e->numCells];
+    memset(staticWallTypes, -1, sizeof(staticWallTypes));
+
     uint16_t cellIdx = 0;
     for (int row = 0; row < rows; row++) {
         for (int col = 0; col < columns; col++) {
             char cellType = layout[col + (row * columns)];
             enum entityType wallType;
-            const float x = (col - ((columns - 1) * 0.5f)) * WALL_THICKNESS;
-            const float y = (row - (rows - 1) * 0.5f) * WALL_THICKNESS;
-
-            b2Vec2 pos = {.x = x, .y = y};
-            mapCell *cell = fastCalloc(1, sizeof(mapCell));
-            cell->ent = NULL;
-            cell->pos = pos;
-            cc_array_add(e->cells, cell);
+            mapCell *cell = &e->cells[cellIdx];
+            const b2Vec2 pos = cell->pos;
 
             bool floating = false;
             float thickness = WALL_THICKNESS;
@@ -489,13 +600,16 @@ void setupMap(env *e, const uint8_t mapIdx) {
                 ERRORF("unknown map layout cell %c", cellType);
             }
 
-            entity *ent = createWall(e, pos, thickness, thickness, cellIdx, wallType, floating);
-            if (!floating) {
-                cell->ent = ent;
+            if (floating) {
+                createWall(e, pos, thickness, thickness, cellIdx, wallType, floating);
+            } else {
+                staticWallTypes[cellIdx] = wallType;
             }
             cellIdx++;
         }
     }
+
+    mergeStaticWalls(e, staticWallTypes);
 }
 
 void computeMapBoundsAndQuadrants(env *e, mapEntry *map) {
@@ -567,19 +681,260 @@ bool posValidDroneSpawnPoint(const env *e, const b2Vec2 pos) {
 }
 #endif
 
+// finds the direction to move in from every cell to reach destCellIdx;
+// only the static walls of the map are considered, cells that are walls
+// are set to 8 and cells that can't reach the destination are left unset
+void pathfindBFS(const mapEntry *map, uint8_t *flatPaths, int8_t (*buffer)[3], uint16_t destCellIdx) {
+    uint8_t(*paths)[map->columns] = (uint8_t(*)[map->columns])flatPaths;
+
+    uint16_t start = 0;
+    uint16_t end = 1;
+
+    if (map->packedLayout[destCellIdx] != 0) {
+        return;
+    }
+    const int8_t destCol = destCellIdx % map->columns;
+    const int8_t destRow = destCellIdx / map->columns;
+
+    buffer[start][0] = 8;
+    buffer[start][1] = destCol;
+    buffer[start][2] = destRow;
+    while (start < end) {
+        const int8_t direction = buffer[start][0];
+        const int8_t startCol = buffer[start][1];
+        const int8_t startRow = buffer[start][2];
+        start++;
+
+        if (startCol < 0 || startCol >= map->columns || startRow < 0 || startRow >= map->rows || paths[startRow][startCol] != UINT8_MAX) {
+            continue;
+        }
+        if (map->packedLayout[startCol + (startRow * map->columns)] != 0) {
+            paths[startRow][startCol] = 8;
+            continue;
+        }
+
+        paths[startRow][startCol] = direction;
+
+        buffer[end][0] = 6; // up
+        buffer[end][1] = startCol;
+        buffer[end][2] = startRow + 1;
+        end++;
+
+        buffer[end][0] = 2; // down
+        buffer[end][1] = startCol;
+        buffer[end][2] = startRow - 1;
+        end++;
+
+        buffer[end][0] = 0; // right
+        buffer[end][1] = startCol - 1;
+        buffer[end][2] = startRow;
+        end++;
+
+        buffer[end][0] = 4; // left
+        buffer[end][1] = startCol + 1;
+        buffer[end][2] = startRow;
+        end++;
+
+        buffer[end][0] = 5; // up left
+        buffer[end][1] = startCol + 1;
+        buffer[end][2] = startRow + 1;
+        end++;
+
+        buffer[end][0] = 3; // down left
+        buffer[end][1] = startCol + 1;
+        buffer[end][2] = startRow - 1;
+        end++;
+
+        buffer[end][0] = 1; // down right
+        buffer[end][1] = startCol - 1;
+        buffer[end][2] = startRow - 1;
+        end++;
+
+        buffer[end][0] = 7; // up right
+        buffer[end][1] = startCol - 1;
+        buffer[end][2] = startRow + 1;
+        end++;
+    }
+}
+
+// precomputes paths from every cell to every other cell; paths only
+// depend on the static layout of the map so they're shared by every env
+void computeMapPaths(mapEntry *map) {
+    const uint16_t numCells = map->columns * map->rows;
+    uint8_t *paths = fastMalloc(numCells * numCells * sizeof(uint8_t));
+    memset(paths, UINT8_MAX, numCells * numCells * sizeof(uint8_t));
+    // every open cell adds 8 neighbors to the queue
+    int8_t(*buffer)[3] = fastCalloc((8 * numCells) + 1, 3 * sizeof(int8_t));
+
+    for (uint16_t i = 0; i < numCells; i++) {
+        pathfindBFS(map, &paths[mapPathOffset(map, 0, i)], buffer, i);
+    }
+
+    fastFree(buffer);
+    map->paths = paths;
+}
+
+// set if map paths were loaded from a file instead of computed
+bool mapPathsMapped = false;
+
+// map paths can be precomputed at build time and saved to a file that
+// is memory mapped at runtime, so every process on a machine shares the
+// same read only copy in the page cache; autopxd can't parse the POSIX
+// headers needed, so only declare what the Cython code needs
+#ifndef AUTOPXD
+#define MAP_PATHS_MAGIC 0x48544150 // "PATH"
+// bump this when pathfindBFS or the file layout changes so stale files
+// are ignored
+const uint32_t MAP_PATHS_VERSION = 1;
+const uint16_t MAP_PATHS_ALIGNMENT = 64;
+
+typedef struct mapPathsHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numMaps;
+    uint32_t reserved;
+} mapPathsHeader;
+
+typedef struct mapPathsEntry {
+    uint64_t layoutHash;
+    uint64_t offset;
+    uint64_t size;
+} mapPathsEntry;
+
+uint8_t *mappedMapPaths = NULL;
+size_t mappedMapPathsSize = 0;
+
+// FNV-1a hash of a map's dimensions and layout, used to detect when a
+// map changed after its paths were saved
+static uint64_t mapLayoutHash(const mapEntry *map) {
+    const uint64_t prime = 0x100000001b3;
+    uint64_t hash = 0xcbf29ce484222325;
+    hash = (hash ^ map->columns) * prime;
+    hash = (hash ^ map->rows) * prime;
+    for (uint16_t i = 0; i < map->columns * map->rows; i++) {
+        hash = (hash ^ (uint8_t)map->layout[i]) * prime;
+    }
+    return hash;
+}
+
+static inline uint64_t alignMapPathsOffset(const uint64_t offset) {
+    return (offset + MAP_PATHS_ALIGNMENT - 1) & ~(uint64_t)(MAP_PATHS_ALIGNMENT - 1);
+}
+
+// writes the paths of every map to a file, initMaps must have been
+// called first
+void saveMapPaths(const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        ERRORF("failed to open map paths file %s: %s", path, strerror(errno));
+    }
+
+    const mapPathsHeader header = {
+        .magic = MAP_PATHS_MAGIC,
+        .version = MAP_PATHS_VERSION,
+        .numMaps = NUM_MAPS,
+    };
+    mapPathsEntry entries[NUM_MAPS];
+    memset(entries, 0x0, sizeof(entries));
+    uint64_t offset = alignMapPathsOffset(sizeof(header) + sizeof(entries));
+    for (uint8_t i = 0; i < NUM_MAPS; i++) {
+        const mapEntry *map = maps[i];
+        const uint16_t numCells = map->columns * map->rows;
+        entries[i].layoutHash = mapLayoutHash(map);
+        entries[i].offset = offset;
+        entries[i].size = numCells * numCells * sizeof(uint8_t);
+        offset = alignMapPathsOffset(offset + entries[i].size);
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(entries, sizeof(entries), 1, file) == 1;
+    for (uint8_t i = 0; ok && i < NUM_MAPS; i++) {
+        ok = fseek(file, entries[i].offset, SEEK_SET) == 0;
+        ok = ok && fwrite(maps[i]->paths, entries[i].size, 1, file) == 1;
+    }
+    if (fclose(file) != 0 || !ok) {
+        ERRORF("failed to write map paths file %s", path);
+    }
+}
+
+// memory maps precomputed paths for every map; returns false and leaves
+// the maps untouched if the file is missing or doesn't match the current
+// maps, in which case initMaps will compute them instead
+bool loadMapPaths(const char *path) {
+    if (mapPathsMapped) {
+        return true;
+    }
+
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        DEBUG_LOGF("failed to open map paths file %s", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(mapPathsHeader) + (NUM_MAPS * sizeof(mapPathsEntry))) {
+        close(fd);
+        return false;
+    }
+    uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    const mapPathsHeader *header = (const mapPathsHeader *)data;
+    bool valid = header->magic == MAP_PATHS_MAGIC && header->version == MAP_PATHS_VERSION && header->numMaps == NUM_MAPS;
+    const mapPathsEntry *entries = (const mapPathsEntry *)(data + sizeof(mapPathsHeader));
+    for (uint8_t i = 0; valid && i < NUM_MAPS; i++) {
+        const mapEntry *map = maps[i];
+        const uint16_t numCells = map->columns * map->rows;
+        valid = entries[i].layoutHash == mapLayoutHash(map) && entries[i].size == (uint64_t)numCells * numCells && entries[i].offset + entries[i].size <= (uint64_t)st.st_size;
+    }
+    if (!valid) {
+        DEBUG_LOGF("map paths file %s is stale", path);
+        munmap(data, st.st_size);
+        return false;
+    }
+
+    for (uint8_t i = 0; i < NUM_MAPS; i++) {
+        maps[i]->paths = data + entries[i].offset;
+    }
+    mappedMapPaths = data;
+    mappedMapPathsSize = st.st_size;
+    mapPathsMapped = true;
+
+    return true;
+}
+
+void unloadMapPaths() {
+    if (!mapPathsMapped) {
+        return;
+    }
+    munmap(mappedMapPaths, mappedMapPathsSize);
+    mappedMapPaths = NULL;
+    mappedMapPathsSize = 0;
+    mapPathsMapped = false;
+}
+#else
+void saveMapPaths(const char *path);
+bool loadMapPaths(const char *path);
+void unloadMapPaths();
+#endif
+
 void initMaps(env *e) {
     for (uint8_t i = 0; i < NUM_MAPS; i++) {
         setupMap(e, i);
         mapEntry *map = maps[i];
 
         computeMapBoundsAndQuadrants(e, map);
+        map->numWalls = cc_array_size(e->walls);
+        map->numMergedWalls = cc_array_size(e->mergedWalls);
 
         bool *droneSpawns = fastCalloc(map->columns * map->rows, sizeof(bool));
         uint8_t *packedLayout = fastCalloc(map->columns * map->rows, sizeof(uint8_t));
         nearEntity *nearestWalls = fastCalloc(MAX_NEAREST_WALLS * map->columns * map->rows, sizeof(nearEntity));
 
-        for (uint16_t i = 0; i < cc_array_size(e->cells); i++) {
-            const mapCell *cell = safe_array_get_at(e->cells, i);
+        for (uint16_t i = 0; i < e->numCells; i++) {
+            const mapCell *cell = &e->cells[i];
 
             // precompute packed map layout
             if (cell->ent != NULL) {
@@ -594,8 +949,8 @@ void initMaps(env *e) {
             uint16_t wallIdx = 0;
             nearEntity walls[map->columns * map->rows];
             memset(walls, 0x0, map->columns * map->rows * sizeof(nearEntity));
-            for (uint16_t j = 0; j < cc_array_size(e->cells); j++) {
-                const mapCell *c = safe_array_get_at(e->cells, j);
+            for (uint16_t j = 0; j < e->numCells; j++) {
+                const mapCell *c = &e->cells[j];
                 if (c->ent == NULL) {
                     continue;
                 }
@@ -612,13 +967,16 @@ void initMaps(env *e) {
         map->droneSpawns = droneSpawns;
         map->packedLayout = packedLayout;
         map->nearestWalls = nearestWalls;
+        if (map->paths == NULL) {
+            computeMapPaths(map);
+        }
 
         // clear floating walls from the map
-        for (uint8_t i = 0; i < cc_array_size(e->floatingWalls); i++) {
-            wallEntity *wall = safe_array_get_at(e->floatingWalls, i);
+        for (uint8_t i = 0; i < slotMapSize(e->floatingWalls); i++) {
+            wallEntity *wall = slotMapGetAt(e->floatingWalls, i);
             destroyWall(e, wall, false);
         }
-        cc_array_remove_all(e->floatingWalls);
+        slotMapClear(e->floatingWalls);
     }
 
     e->mapIdx = -1;
@@ -630,7 +988,12 @@ void destroyMaps() {
         fastFree(map->droneSpawns);
         fastFree(map->packedLayout);
         fastFree(map->nearestWalls);
+        if (!mapPathsMapped) {
+            fastFree(map->paths);
+        }
+        map->paths = NULL;
     }
+    unloadMapPaths();
 }
 
 void placeRandFloatingWall(env *e, const enum entityType wallType) {
@@ -0,0 +1,256 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "env.h"
+#include "env_state.h"
+#include "tool_env.h"
+
+// times hot functions in isolation against a frozen env state so a
+// regression can be pinned on a sub-system; the state has 4 drones,
+// sudden death walls and many live projectiles, and is restored before
+// every repetition so each one does the same work
+
+#define MICROBENCH_SEED 1337
+#define NUM_BENCH_DRONES 4
+#define STATE_WARMUP_STEPS 256
+#define STATE_MAX_SETTLE_STEPS 100000
+#define STATE_PROJECTILES 48
+#define WARMUP_CALLS 1000
+#define DEFAULT_REPETITIONS 30
+#define DEFAULT_CALLS_PER_REPETITION 2000
+
+typedef void (*benchFn)(env *e);
+
+typedef struct microbench {
+    const char *name;
+    benchFn fn;
+} microbench;
+
+typedef struct benchStats {
+    double meanNs;
+    double stddevNs;
+    double minNs;
+    double medianNs;
+} benchStats;
+
+void benchComputeObs(env *e) {
+    computeObs(e);
+}
+
+void benchComputeObsEntityCache(env *e) {
+    computeObsEntityCache(e);
+}
+
+void benchComputeMapObs(env *e) {
+    computeObsEntityCache(e);
+    for (uint8_t i = 0; i < e->numAgents; i++) {
+        computeMapObs(e, i, e->obsBytes * i);
+    }
+}
+
+void benchComputeNearObs(env *e) {
+    computeObsEntityCache(e);
+    for (uint8_t i = 0; i < e->numAgents; i++) {
+        const droneEntity *drone = safe_array_get_at(e->drones, i);
+        const uint16_t discreteObsStart = e->obsBytes * i;
+        float *continuousObs = (float *)(e->obs + discreteObsStart + e->discreteObsBytes);
+        computeNearObs(e, drone, discreteObsStart, continuousObs);
+    }
+}
+
+void benchScriptedAgentActions(env *e) {
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        droneEntity *drone = safe_array_get_at(e->drones, i);
+        const agentActions actions = scriptedAgentActions(e, drone);
+        MAYBE_UNUSED(actions);
+    }
+}
+
+void benchFindOpenPos(env *e) {
+    b2Vec2 pos;
+    findOpenPos(e, DRONE_SHAPE, &pos, -1);
+}
+
+void benchFindNearWalls(env *e) {
+    nearEntity nearWalls[NUM_NEAR_WALL_OBS];
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        const droneEntity *drone = safe_array_get_at(e->drones, i);
+        findNearWalls(e, drone, nearWalls, NUM_NEAR_WALL_OBS);
+    }
+}
+
+// a full projectile lifecycle; the body is recycled back to the free
+// list the same way stepping would after two steps
+void benchCreateDestroyProjectile(env *e) {
+    droneEntity *drone = safe_array_get_at(e->drones, 0);
+    const b2Vec2 aim = b2Normalize((b2Vec2){.x = randFloat(&e->randState, -1.0f, 1.0f), .y = 1.0f});
+    createProjectile(e, drone, aim);
+
+    projectileEntity *projectile = slotMapGetAt(e->projectiles, slotMapSize(e->projectiles) - 1);
+    destroyProjectile(e, projectile, false, true);
+    recycleProjectileBodies(e);
+    recycleProjectileBodies(e);
+}
+
+// the frozen state every benchmark starts from, set once it's saved
+const envState *benchState = NULL;
+
+void benchRestoreEnvState(env *e) {
+    const enum envStateStatus status = restoreEnvState(e, benchState);
+    ASSERTF(status == ENV_STATE_OK, "status: %s", envStateStatusMessage(status));
+    MAYBE_UNUSED(status);
+}
+
+const microbench microbenches[] = {
+    {.name = "computeObs", .fn = benchComputeObs},
+    {.name = "computeObsEntityCache", .fn = benchComputeObsEntityCache},
+    {.name = "computeMapObs", .fn = benchComputeMapObs},
+    {.name = "computeNearObs", .fn = benchComputeNearObs},
+    {.name = "scriptedAgentActions", .fn = benchScriptedAgentActions},
+    {.name = "findOpenPos", .fn = benchFindOpenPos},
+    {.name = "findNearWalls", .fn = benchFindNearWalls},
+    {.name = "createDestroyProjectile", .fn = benchCreateDestroyProjectile},
+    {.name = "restoreEnvState", .fn = benchRestoreEnvState},
+};
+
+bool allDronesAlive(const env *e) {
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        const droneEntity *drone = safe_array_get_at(e->drones, i);
+        if (drone->dead) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// plays the env with random actions for a while, then places the first
+// set of sudden death walls and fires projectiles from every drone
+void synthesizeState(env *e) {
+    randActions(e);
+    setupEnv(e);
+
+    uint32_t steps = 0;
+    while (steps < STATE_WARMUP_STEPS || e->needsReset || !allDronesAlive(e)) {
+        if (steps == STATE_MAX_SETTLE_STEPS) {
+            ERROR("failed to synthesize a state with every drone alive");
+        }
+        randActions(e);
+        stepEnv(e);
+        steps++;
+    }
+
+    e->stepsLeft = 0;
+    e->suddenDeathSteps = 0;
+    handleSuddenDeath(e);
+    e->suddenDeathSteps = e->totalSuddenDeathSteps;
+
+    while (slotMapSize(e->projectiles) < STATE_PROJECTILES) {
+        droneEntity *drone = safe_array_get_at(e->drones, slotMapSize(e->projectiles) % e->numDrones);
+        const b2Vec2 aim = b2Normalize((b2Vec2){.x = randFloat(&e->randState, -1.0f, 1.0f), .y = randFloat(&e->randState, -1.0f, 1.0f)});
+        createProjectile(e, drone, aim);
+    }
+    computeObs(e);
+}
+
+int compareDoubles(const void *a, const void *b) {
+    const double da = *(const double *)a;
+    const double db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+benchStats runMicrobench(env *e, const envState *state, const microbench *mb, const uint16_t repetitions, const uint32_t calls) {
+    restoreEnvState(e, state);
+    for (uint32_t i = 0; i < WARMUP_CALLS; i++) {
+        mb->fn(e);
+    }
+
+    double samples[repetitions];
+    for (uint16_t r = 0; r < repetitions; r++) {
+        restoreEnvState(e, state);
+
+        const uint64_t start = nowNs();
+        for (uint32_t i = 0; i < calls; i++) {
+            mb->fn(e);
+        }
+        samples[r] = (double)(nowNs() - start) / calls;
+    }
+
+    benchStats stats = {0};
+    for (uint16_t r = 0; r < repetitions; r++) {
+        stats.meanNs += samples[r] / repetitions;
+    }
+    double variance = 0.0;
+    for (uint16_t r = 0; r < repetitions; r++) {
+        const double diff = samples[r] - stats.meanNs;
+        variance += diff * diff;
+    }
+    if (repetitions > 1) {
+        variance /= repetitions - 1;
+    }
+    stats.stddevNs = sqrt(variance);
+
+    qsort(samples, repetitions, sizeof(double), compareDoubles);
+    stats.minNs = samples[0];
+    stats.medianNs = samples[repetitions / 2];
+    return stats;
+}
+
+// usage:
+//   microbench [repetitions] [calls per repetition] [map paths file]
+int main(int argc, char **argv) {
+    uint16_t repetitions = DEFAULT_REPETITIONS;
+    uint32_t calls = DEFAULT_CALLS_PER_REPETITION;
+    if (argc > 1) {
+        repetitions = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        calls = strtoul(argv[2], NULL, 10);
+    }
+    if (repetitions == 0 || calls == 0) {
+        fprintf(stderr, "repetitions and calls per repetition must be greater than 0\n");
+        return 1;
+    }
+
+    const char *mapPathsFile = NULL;
+    if (argc > 3) {
+        mapPathsFile = argv[3];
+    }
+
+    toolEnv t = createToolEnv(NUM_BENCH_DRONES, NUM_BENCH_DRONES, -1, MICROBENCH_SEED, false, true);
+    env *e = t.e;
+    initToolMaps(e, mapPathsFile);
+
+    synthesizeState(e);
+    envState *state = createEnvState();
+    saveEnvState(e, state);
+    benchState = state;
+
+    printf("{\n");
+    printf("  \"map\": %d,\n", e->mapIdx);
+    printf("  \"drones\": %d,\n", e->numDrones);
+    printf("  \"projectiles\": %d,\n", slotMapSize(e->projectiles));
+    printf("  \"repetitions\": %u,\n", repetitions);
+    printf("  \"calls_per_repetition\": %u,\n", calls);
+    printf("  \"benchmarks\": [\n");
+    const uint8_t numMicrobenches = sizeof(microbenches) / sizeof(microbenches[0]);
+    for (uint8_t i = 0; i < numMicrobenches; i++) {
+        const benchStats stats = runMicrobench(e, state, &microbenches[i], repetitions, calls);
+        printf("    {\n");
+        printf("      \"name\": \"%s\",\n", microbenches[i].name);
+        printf("      \"mean_ns\": %f,\n", stats.meanNs);
+        printf("      \"stddev_ns\": %f,\n", stats.stddevNs);
+        printf("      \"cv\": %f,\n", stats.meanNs != 0.0 ? stats.stddevNs / stats.meanNs : 0.0);
+        printf("      \"min_ns\": %f,\n", stats.minNs);
+        printf("      \"median_ns\": %f\n", stats.medianNs);
+        printf("    }%s\n", i == numMicrobenches - 1 ? "" : ",");
+        fflush(stdout);
+    }
+    printf("  ]\n");
+    printf("}\n");
+
+    destroyEnvState(state);
+    destroyToolEnv(&t);
+    destroyMaps();
+    return 0;
+}
@@ -0,0 +1,99 @@
+#ifndef IMPULSE_WARS_POOL_H
+#define IMPULSE_WARS_POOL_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "helpers.h"
+
+// a fixed size object pool; items are carved out of blocks that are
+// allocated when the pool runs out of free items and are never freed
+// until the pool is destroyed, so once a pool has grown to the peak
+// number of live items allocating and freeing an item never touches
+// the heap; freed items are kept in an intrusive free list
+
+typedef struct poolBlock {
+    struct poolBlock *next;
+} poolBlock;
+
+typedef struct objectPool {
+    poolBlock *blocks;
+    void *freeList;
+    uint32_t itemSize;
+    uint16_t itemsPerBlock;
+    // number of items currently allocated
+    uint32_t live;
+    // incremented every time the pool allocates a block, may be shared
+    // across multiple pools
+    uint64_t *heapAllocs;
+} objectPool;
+
+// alignment of every item, large enough for any pooled type
+#define POOL_ALIGN 16
+#define POOL_BLOCK_HEADER_SIZE ((sizeof(poolBlock) + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1))
+
+void initPool(objectPool *pool, const uint32_t itemSize, const uint16_t itemsPerBlock, uint64_t *heapAllocs) {
+    ASSERT(itemsPerBlock != 0);
+    pool->blocks = NULL;
+    pool->freeList = NULL;
+    // items have to be big enough to hold the free list pointer
+    pool->itemSize = (max(itemSize, (uint32_t)sizeof(void *)) + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1);
+    pool->itemsPerBlock = itemsPerBlock;
+    pool->live = 0;
+    pool->heapAllocs = heapAllocs;
+}
+
+void destroyPool(objectPool *pool) {
+    ASSERTF(pool->live == 0, "live items: %d", pool->live);
+    poolBlock *block = pool->blocks;
+    while (block != NULL) {
+        poolBlock *next = block->next;
+        fastFree(block);
+        block = next;
+    }
+    pool->blocks = NULL;
+    pool->freeList = NULL;
+}
+
+static void poolGrow(objectPool *pool) {
+    poolBlock *block = fastMalloc(POOL_BLOCK_HEADER_SIZE + ((size_t)pool->itemSize * pool->itemsPerBlock));
+    if (block == NULL) {
+        ERROR("failed to allocate pool block");
+    }
+    block->next = pool->blocks;
+    pool->blocks = block;
+    if (pool->heapAllocs != NULL) {
+        (*pool->heapAllocs)++;
+    }
+
+    // push items in reverse so they're handed out in address order
+    uint8_t *items = (uint8_t *)block + POOL_BLOCK_HEADER_SIZE;
+    for (int32_t i = pool->itemsPerBlock - 1; i >= 0; i--) {
+        void *item = items + ((size_t)i * pool->itemSize);
+        *(void **)item = pool->freeList;
+        pool->freeList = item;
+    }
+}
+
+// returns a zeroed item
+void *poolAlloc(objectPool *pool) {
+    if (pool->freeList == NULL) {
+        poolGrow(pool);
+    }
+    void *item = pool->freeList;
+    pool->freeList = *(void **)item;
+    pool->live++;
+
+    memset(item, 0x0, pool->itemSize);
+    return item;
+}
+
+void poolFree(objectPool *pool, void *item) {
+    ASSERT(item != NULL);
+    ASSERT(pool->live != 0);
+    *(void **)item = pool->freeList;
+    pool->freeList = item;
+    pool->live--;
+}
+
+#endif
@@ -701,7 +701,7 @@ void renderUI(const env *e, const bool starting) {
     renderTimer(e, timerStr, PUFF_WHITE);
 }
 
-void renderBrakeTrails(const env *e, const bool ending) {
+void renderBrakeTrails(env *e, const bool ending) {
     const float maxLifetime = 3.0f * e->frameRate;
     const float radius = 0.3f * e->renderScale;
 
@@ -712,7 +712,7 @@ void renderBrakeTrails(const env *e, const bool ending) {
         if (trailPoint->lifetime == UINT16_MAX) {
             trailPoint->lifetime = maxLifetime;
         } else if (trailPoint->lifetime == 0) {
-            fastFree(trailPoint);
+            poolFree(&e->trailPointPool, trailPoint);
             cc_array_iter_remove(&brakeTrailIter, NULL);
             continue;
         }
@@ -725,7 +725,7 @@ void renderBrakeTrails(const env *e, const bool ending) {
     }
 }
 
-void renderExplosions(const env *e) {
+void renderExplosions(env *e) {
     const uint16_t maxRenderSteps = EXPLOSION_TIME * e->frameRate;
 
     CC_ArrayIter iter;
@@ -736,7 +736,7 @@ void renderExplosions(const env *e) {
         if (explosion->renderSteps == UINT16_MAX) {
             explosion->renderSteps = maxRenderSteps;
         } else if (explosion->renderSteps == 0) {
-            fastFree(explosion);
+            poolFree(&e->explosionPool, explosion);
             cc_array_iter_remove(&iter, NULL);
             continue;
         }
@@ -965,14 +965,14 @@ b2Vec2 b2RotatedPolygonVec(const float cosA, const float sinA, const b2Vec2 pos,
     };
 }
 
-void renderDronePieces(const env *e, const bool ending) {
+void renderDronePieces(env *e, const bool ending) {
     const float maxLifetime = e->frameRate * DRONE_PIECE_LIFETIME;
 
-    CC_ArrayIter iter;
-    cc_array_iter_init(&iter, e->dronePieces);
+    slotMapIter iter;
+    slotMapIterInit(&iter, e->dronePieces);
     dronePieceEntity *piece;
 
-    while (cc_array_iter_next(&iter, (void **)&piece) != CC_ITER_END) {
+    while (slotMapIterNext(&iter, (void **)&piece)) {
         if (piece->lifetime == UINT16_MAX) {
             piece->lifetime = maxLifetime;
         }
@@ -1022,8 +1022,8 @@ void renderDronePieces(const env *e, const bool ending) {
 
         piece->lifetime--;
         if (piece->lifetime == 0) {
-            destroyDronePiece(piece);
-            cc_array_iter_remove_fast(&iter, NULL);
+            slotMapIterRemove(&iter);
+            destroyDronePiece(e, piece);
         }
     }
 }
@@ -1322,16 +1322,16 @@ void renderDroneUI(const env *e, const droneEntity *drone) {
 }
 
 void renderProjectileTrail(const env *e, const projectileEntity *proj, const Color color) {
-    if (proj->trailPoints.length < 2) {
+    if (proj->trailPoints == NULL || proj->trailPoints->length < 2) {
         return; // need at least two points
     }
 
     const float maxWidth = proj->weaponInfo->radius;
-    const float numPoints = proj->trailPoints.length;
+    const float numPoints = proj->trailPoints->length;
 
-    for (uint8_t i = 0; i < proj->trailPoints.length - 1; i++) {
-        const Vector2 p0 = proj->trailPoints.points[i];
-        const Vector2 p1 = proj->trailPoints.points[i + 1];
+    for (uint8_t i = 0; i < proj->trailPoints->length - 1; i++) {
+        const Vector2 p0 = proj->trailPoints->points[i];
+        const Vector2 p1 = proj->trailPoints->points[i + 1];
 
         // Compute a perpendicular vector for the segment
         Vector2 dir = Vector2Subtract(p1, p0);
@@ -1373,11 +1373,11 @@ void renderProjectileTrail(const env *e, const projectileEntity *proj, const Col
 }
 
 void renderProjectiles(env *e) {
-    for (size_t i = 0; i < cc_array_size(e->projectiles); i++) {
-        projectileEntity *projectile = safe_array_get_at(e->projectiles, i);
+    for (size_t i = 0; i < slotMapSize(e->projectiles); i++) {
+        projectileEntity *projectile = slotMapGetAt(e->projectiles, i);
 
         const Color color = getProjectileColor(projectile->weaponInfo->type);
-        float adj = 2.0 - projectile->distance / 10.0f;
+        float adj = 2.0 - projectileDistance(e, projectile) / 10.0f;
         if (adj < 1.0f) {
             adj = 1.0f;
         }
@@ -1487,8 +1487,8 @@ void _renderEnv(env *e, const bool starting, const bool ending, const int8_t win
         SetShaderValue(e->client->grid, e->client->gridColorLoc[drone->idx], gridColor, SHADER_UNIFORM_VEC4);
     }
 
-    for (size_t i = 0; i < cc_array_size(e->projectiles); i++) {
-        projectileEntity *projectile = safe_array_get_at(e->projectiles, i);
+    for (size_t i = 0; i < slotMapSize(e->projectiles); i++) {
+        projectileEntity *projectile = slotMapGetAt(e->projectiles, i);
         const Color color = getProjectileColor(projectile->weaponInfo->type);
         Light* light = &e->client->lights[e->client->lightIdx];
         e->client->lightIdx++;
@@ -1519,8 +1519,8 @@ void _renderEnv(env *e, const bool starting, const bool ending, const int8_t win
     BeginShaderMode(e->client->shader);
     
     /*
-    for (size_t i = 0; i < cc_array_size(e->cells); i++) {
-        const mapCell *cell = safe_array_get_at(e->cells, i);
+    for (size_t i = 0; i < e->numCells; i++) {
+        const mapCell *cell = &e->cells[i];
         if (cell->ent != NULL) {
             continue;
         }
@@ -1587,8 +1587,8 @@ void _renderEnv(env *e, const bool starting, const bool ending, const int8_t win
     EndBlendMode();
 
 
-    for (size_t i = 0; i < cc_array_size(e->pickups); i++) {
-        const weaponPickupEntity *pickup = safe_array_get_at(e->pickups, i);
+    for (size_t i = 0; i < slotMapSize(e->pickups); i++) {
+        const weaponPickupEntity *pickup = slotMapGetAt(e->pickups, i);
         renderWeaponPickup(e, pickup);
     }
 
@@ -1615,8 +1615,8 @@ void _renderEnv(env *e, const bool starting, const bool ending, const int8_t win
         renderWall(e, wall);
     }
 
-    for (size_t i = 0; i < cc_array_size(e->floatingWalls); i++) {
-        const wallEntity *wall = safe_array_get_at(e->floatingWalls, i);
+    for (size_t i = 0; i < slotMapSize(e->floatingWalls); i++) {
+        const wallEntity *wall = slotMapGetAt(e->floatingWalls, i);
         renderWall(e, wall);
     }
 
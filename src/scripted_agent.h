@@ -17,88 +17,7 @@ const float BURST_MIN_RADIUS_SQUARED = SQUARED(DRONE_BURST_RADIUS_MIN);
 const float MOVE_SPEED_SQUARED = SQUARED(5.0f);
 
 static inline uint32_t pathOffset(const env *e, uint16_t srcCellIdx, uint16_t destCellIdx) {
-    const uint8_t srcCol = srcCellIdx % e->map->columns;
-    const uint8_t srcRow = srcCellIdx / e->map->columns;
-    const uint8_t destCol = destCellIdx % e->map->columns;
-    const uint8_t destRow = destCellIdx / e->map->columns;
-    return (destRow * e->map->rows * e->map->columns * e->map->rows) + (destCol * e->map->rows * e->map->columns) + (srcRow * e->map->columns) + srcCol;
-}
-
-void pathfindBFS(const env *e, uint8_t *flatPaths, uint16_t destCellIdx) {
-    uint8_t(*paths)[e->map->columns] = (uint8_t(*)[e->map->columns])flatPaths;
-    int8_t(*buffer)[3] = (int8_t(*)[3])e->mapPathing[e->mapIdx].pathBuffer;
-
-    uint16_t start = 0;
-    uint16_t end = 1;
-
-    const mapCell *cell = safe_array_get_at(e->cells, destCellIdx);
-    if (cell->ent != NULL && entityTypeIsWall(cell->ent->type)) {
-        return;
-    }
-    const int8_t destCol = destCellIdx % e->map->columns;
-    const int8_t destRow = destCellIdx / e->map->columns;
-
-    buffer[start][0] = 8;
-    buffer[start][1] = destCol;
-    buffer[start][2] = destRow;
-    while (start < end) {
-        const int8_t direction = buffer[start][0];
-        const int8_t startCol = buffer[start][1];
-        const int8_t startRow = buffer[start][2];
-        start++;
-
-        if (startCol < 0 || startCol >= e->map->columns || startRow < 0 || startRow >= e->map->rows || paths[startRow][startCol] != UINT8_MAX) {
-            continue;
-        }
-        int16_t cellIdx = cellIndex(e, startCol, startRow);
-        const mapCell *cell = safe_array_get_at(e->cells, cellIdx);
-        if (cell->ent != NULL && entityTypeIsWall(cell->ent->type)) {
-            paths[startRow][startCol] = 8;
-            continue;
-        }
-
-        paths[startRow][startCol] = direction;
-
-        buffer[end][0] = 6; // up
-        buffer[end][1] = startCol;
-        buffer[end][2] = startRow + 1;
-        end++;
-
-        buffer[end][0] = 2; // down
-        buffer[end][1] = startCol;
-        buffer[end][2] = startRow - 1;
-        end++;
-
-        buffer[end][0] = 0; // right
-        buffer[end][1] = startCol - 1;
-        buffer[end][2] = startRow;
-        end++;
-
-        buffer[end][0] = 4; // left
-        buffer[end][1] = startCol + 1;
-        buffer[end][2] = startRow;
-        end++;
-
-        buffer[end][0] = 5; // up left
-        buffer[end][1] = startCol + 1;
-        buffer[end][2] = startRow + 1;
-        end++;
-
-        buffer[end][0] = 3; // down left
-        buffer[end][1] = startCol + 1;
-        buffer[end][2] = startRow - 1;
-        end++;
-
-        buffer[end][0] = 1; // down right
-        buffer[end][1] = startCol - 1;
-        buffer[end][2] = startRow - 1;
-        end++;
-
-        buffer[end][0] = 7; // up right
-        buffer[end][1] = startCol - 1;
-        buffer[end][2] = startRow + 1;
-        end++;
-    }
+    return mapPathOffset(e->map, srcCellIdx, destCellIdx);
 }
 
 float distanceWithDamping(const env *e, const droneEntity *drone, const b2Vec2 direction, const float linearDamping, const float steps) {
@@ -189,14 +108,7 @@ void moveTo(env *e, const droneEntity *drone, agentActions *actions, const b2Vec
         return;
     }
 
-    uint32_t pathIdx = pathOffset(e, drone->mapCellIdx, dstIdx);
-    uint8_t *paths = e->mapPathing[e->mapIdx].paths;
-    uint8_t direction = paths[pathIdx];
-    if (direction == UINT8_MAX) {
-        uint32_t bfsIdx = pathOffset(e, 0, dstIdx);
-        pathfindBFS(e, &paths[bfsIdx], dstIdx);
-        direction = paths[pathIdx];
-    }
+    const uint8_t direction = e->map->paths[pathOffset(e, drone->mapCellIdx, dstIdx)];
     if (direction >= 8) {
         return;
     }
@@ -347,8 +259,8 @@ agentActions scriptedAgentActions(env *e, droneEntity *drone) {
         handleWallProximity(e, drone, wall, output.distance, &actions);
     }
 
-    for (uint8_t i = 0; i < cc_array_size(e->floatingWalls); i++) {
-        wallEntity *floatingWall = safe_array_get_at(e->floatingWalls, i);
+    for (uint8_t i = 0; i < slotMapSize(e->floatingWalls); i++) {
+        wallEntity *floatingWall = slotMapGetAt(e->floatingWalls, i);
         if (floatingWall->type != DEATH_WALL_ENTITY) {
             continue;
         }
@@ -370,11 +282,11 @@ agentActions scriptedAgentActions(env *e, droneEntity *drone) {
     }
 
     // get a weapon if the standard weapon is active
-    if (drone->weaponInfo->type == STANDARD_WEAPON && cc_array_size(e->pickups) != 0) {
+    if (drone->weaponInfo->type == STANDARD_WEAPON && slotMapSize(e->pickups) != 0) {
         nearEntity nearPickups[MAX_WEAPON_PICKUPS] = {0};
         uint8_t numActivePickups = 0;
-        for (uint8_t i = 0; i < cc_array_size(e->pickups); i++) {
-            weaponPickupEntity *pickup = safe_array_get_at(e->pickups, i);
+        for (uint8_t i = 0; i < slotMapSize(e->pickups); i++) {
+            weaponPickupEntity *pickup = slotMapGetAt(e->pickups, i);
             if (pickup->floatingWallsTouching > 0) {
                 continue;
             }
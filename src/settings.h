@@ -31,7 +31,10 @@ const uint8_t SUDDEN_DEATH_STEPS = 5;
 
 const uint8_t MAX_DRONES = _MAX_DRONES;
 
-const uint16_t LOG_BUFFER_SIZE = 1024;
+// initial capacity of entity slot maps, they grow as needed
+const uint16_t INITIAL_SLOT_MAP_CAPACITY = 32;
+// number of items allocated at once when an entity pool runs out
+const uint16_t POOL_BLOCK_ITEMS = 64;
 
 // reward settings
 const float WIN_REWARD = 1.5f;
@@ -62,7 +65,8 @@ const uint16_t NEAR_WALL_TYPES_OBS_OFFSET = MAP_OBS_SIZE;
 const uint8_t NUM_FLOATING_WALL_OBS = _NUM_FLOATING_WALL_OBS;
 const uint16_t FLOATING_WALL_TYPES_OBS_OFFSET = NEAR_WALL_TYPES_OBS_OFFSET + NUM_NEAR_WALL_OBS;
 
-const uint8_t NUM_PROJECTILE_OBS = 30;
+#define _NUM_PROJECTILE_OBS 30
+const uint8_t NUM_PROJECTILE_OBS = _NUM_PROJECTILE_OBS;
 const uint16_t PROJECTILE_DRONE_OBS_OFFSET = FLOATING_WALL_TYPES_OBS_OFFSET + NUM_FLOATING_WALL_OBS;
 const uint16_t PROJECTILE_WEAPONS_OBS_OFFSET = PROJECTILE_DRONE_OBS_OFFSET + NUM_PROJECTILE_OBS;
 
@@ -73,31 +77,42 @@ const uint16_t WEAPON_PICKUP_WEAPONS_OBS_OFFSET = PROJECTILE_WEAPONS_OBS_OFFSET
 const uint16_t ENEMY_DRONE_WEAPONS_OBS_OFFSET = WEAPON_PICKUP_WEAPONS_OBS_OFFSET + NUM_WEAPON_PICKUP_OBS;
 
 // continuous observations
-const uint8_t NEAR_WALL_POS_OBS_SIZE = 2;
-const uint8_t NEAR_WALL_OBS_SIZE = NUM_NEAR_WALL_OBS * NEAR_WALL_POS_OBS_SIZE;
+#define _NEAR_WALL_POS_OBS_SIZE 2
+const uint8_t NEAR_WALL_POS_OBS_SIZE = _NEAR_WALL_POS_OBS_SIZE;
+#define _NEAR_WALL_OBS_SIZE (_NUM_NEAR_WALL_OBS * _NEAR_WALL_POS_OBS_SIZE)
+const uint8_t NEAR_WALL_OBS_SIZE = _NEAR_WALL_OBS_SIZE;
 const uint16_t NEAR_WALL_POS_OBS_OFFSET = 0;
 
-const uint8_t FLOATING_WALL_INFO_OBS_SIZE = 5;
-const uint8_t FLOATING_WALL_OBS_SIZE = NUM_FLOATING_WALL_OBS * FLOATING_WALL_INFO_OBS_SIZE;
+#define _FLOATING_WALL_INFO_OBS_SIZE 5
+const uint8_t FLOATING_WALL_INFO_OBS_SIZE = _FLOATING_WALL_INFO_OBS_SIZE;
+#define _FLOATING_WALL_OBS_SIZE (_NUM_FLOATING_WALL_OBS * _FLOATING_WALL_INFO_OBS_SIZE)
+const uint8_t FLOATING_WALL_OBS_SIZE = _FLOATING_WALL_OBS_SIZE;
 const uint16_t FLOATING_WALL_INFO_OBS_OFFSET = NEAR_WALL_POS_OBS_OFFSET + NEAR_WALL_OBS_SIZE;
 
-const uint8_t WEAPON_PICKUP_POS_OBS_SIZE = 2;
-const uint8_t WEAPON_PICKUP_OBS_SIZE = NUM_WEAPON_PICKUP_OBS * WEAPON_PICKUP_POS_OBS_SIZE;
+#define _WEAPON_PICKUP_POS_OBS_SIZE 2
+const uint8_t WEAPON_PICKUP_POS_OBS_SIZE = _WEAPON_PICKUP_POS_OBS_SIZE;
+#define _WEAPON_PICKUP_OBS_SIZE (_NUM_WEAPON_PICKUP_OBS * _WEAPON_PICKUP_POS_OBS_SIZE)
+const uint8_t WEAPON_PICKUP_OBS_SIZE = _WEAPON_PICKUP_OBS_SIZE;
 const uint16_t WEAPON_PICKUP_POS_OBS_OFFSET = FLOATING_WALL_INFO_OBS_OFFSET + FLOATING_WALL_OBS_SIZE;
 
-const uint8_t PROJECTILE_INFO_OBS_SIZE = 4;
-const uint8_t PROJECTILE_OBS_SIZE = NUM_PROJECTILE_OBS * PROJECTILE_INFO_OBS_SIZE;
+#define _PROJECTILE_INFO_OBS_SIZE 4
+const uint8_t PROJECTILE_INFO_OBS_SIZE = _PROJECTILE_INFO_OBS_SIZE;
+#define _PROJECTILE_OBS_SIZE (_NUM_PROJECTILE_OBS * _PROJECTILE_INFO_OBS_SIZE)
+const uint8_t PROJECTILE_OBS_SIZE = _PROJECTILE_OBS_SIZE;
 const uint16_t PROJECTILE_INFO_OBS_OFFSET = WEAPON_PICKUP_POS_OBS_OFFSET + WEAPON_PICKUP_OBS_SIZE;
 
 const uint16_t ENEMY_DRONE_OBS_OFFSET = PROJECTILE_INFO_OBS_OFFSET + PROJECTILE_OBS_SIZE;
-const uint8_t ENEMY_DRONE_OBS_SIZE = 24;
+#define _ENEMY_DRONE_OBS_SIZE 24
+const uint8_t ENEMY_DRONE_OBS_SIZE = _ENEMY_DRONE_OBS_SIZE;
 
-const uint8_t DRONE_OBS_SIZE = 22;
+#define _DRONE_OBS_SIZE 22
+const uint8_t DRONE_OBS_SIZE = _DRONE_OBS_SIZE;
 
-const uint8_t MISC_OBS_SIZE = 1;
+#define _MISC_OBS_SIZE 1
+const uint8_t MISC_OBS_SIZE = _MISC_OBS_SIZE;
 
 const uint16_t _DISCRETE_OBS_SIZE = MAP_OBS_SIZE + NUM_NEAR_WALL_OBS + NUM_FLOATING_WALL_OBS + (NUM_PROJECTILE_OBS * 2) + NUM_WEAPON_PICKUP_OBS + 1;
-const uint16_t _CONTINUOUS_OBS_SIZE = NEAR_WALL_OBS_SIZE + FLOATING_WALL_OBS_SIZE + WEAPON_PICKUP_OBS_SIZE + PROJECTILE_OBS_SIZE + DRONE_OBS_SIZE + MISC_OBS_SIZE;
+#define _CONTINUOUS_OBS_SIZE (_NEAR_WALL_OBS_SIZE + _FLOATING_WALL_OBS_SIZE + _WEAPON_PICKUP_OBS_SIZE + _PROJECTILE_OBS_SIZE + _DRONE_OBS_SIZE + _MISC_OBS_SIZE)
 
 uint16_t discreteObsSize(uint8_t numDrones) {
     return _DISCRETE_OBS_SIZE + ((numDrones - 1));
@@ -107,8 +122,32 @@ uint16_t continuousObsSize(uint8_t numDrones) {
     return _CONTINUOUS_OBS_SIZE + ((numDrones - 1) * ENEMY_DRONE_OBS_SIZE);
 }
 
+// continuousObsSize(_MAX_DRONES) as a constant so buffers can be sized
+// at compile time
+#define MAX_CONTINUOUS_OBS_SIZE (_CONTINUOUS_OBS_SIZE + ((_MAX_DRONES - 1) * _ENEMY_DRONE_OBS_SIZE))
+
+// 8 bit continuous observations are stored as round(value * INT8_OBS_SCALE)
+const float INT8_OBS_SCALE = 127.0f;
+
+uint8_t obsFormatValueBytes(enum obsFormat format) {
+    switch (format) {
+    case OBS_FORMAT_FLOAT16:
+        return sizeof(uint16_t);
+    case OBS_FORMAT_INT8:
+        return sizeof(int8_t);
+    default:
+        return sizeof(float);
+    }
+}
+
+// continuous observations always start at a float aligned offset
+uint16_t formattedObsBytes(uint8_t numDrones, enum obsFormat format) {
+    const uint16_t discreteBytes = alignedSize(discreteObsSize(numDrones) * sizeof(uint8_t), sizeof(float));
+    return alignedSize(discreteBytes + (continuousObsSize(numDrones) * obsFormatValueBytes(format)), sizeof(float));
+}
+
 uint16_t obsBytes(uint8_t numDrones) {
-    return alignedSize((discreteObsSize(numDrones) * sizeof(uint8_t)) + (continuousObsSize(numDrones) * sizeof(float)), sizeof(float));
+    return formattedObsBytes(numDrones, OBS_FORMAT_FLOAT32);
 }
 
 const float MAX_X_POS = 150.0f;
@@ -148,6 +187,11 @@ const float PICKUP_THICKNESS = 3.0f;
 const float PICKUP_SPAWN_DISTANCE_SQUARED = SQUARED(10.0f);
 const float PICKUP_RESPAWN_WAIT = 3.0f;
 const float SUDDEN_DEATH_PICKUP_RESPAWN_WAIT = 2.0f;
+// if true, weapon pickup bodies are disabled while waiting to respawn
+// and teleported and re-enabled when respawning instead of being
+// destroyed and re-created; off by default as disabling and
+// teleporting a body costs about as much as re-creating it in box2d
+const bool PERSISTENT_PICKUP_BODIES = false;
 
 // drone settings
 const float DRONE_WALL_SPAWN_DISTANCE = 2.0f;
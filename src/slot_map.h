@@ -0,0 +1,190 @@
+#ifndef IMPULSE_WARS_SLOT_MAP_H
+#define IMPULSE_WARS_SLOT_MAP_H
+
+#include <stdint.h>
+
+#include "helpers.h"
+
+// a generational slot map; items are stored in a dense array so iterating
+// is as fast as iterating over a CC_Array, but every item also gets a
+// stable handle that can be used to look it up or remove it in O(1)
+// instead of searching the array for it; removing an item bumps the
+// generation of its slot so stale handles can be detected
+
+// the low 16 bits are the slot index, the high 16 bits the generation
+typedef uint32_t slotHandle;
+#define INVALID_SLOT_HANDLE UINT32_MAX
+
+typedef struct slotMapSlot {
+    // index into dense if the slot is in use, otherwise the next free slot
+    uint16_t idx;
+    uint16_t generation;
+} slotMapSlot;
+
+typedef struct slotMap {
+    void **dense;
+    // slot index of each item in dense
+    uint16_t *denseSlots;
+    slotMapSlot *slots;
+    uint16_t size;
+    uint16_t capacity;
+    // number of slots that have ever been used
+    uint16_t usedSlots;
+    uint16_t freeSlot;
+    // incremented every time the slot map grows, may be NULL
+    uint64_t *heapAllocs;
+} slotMap;
+
+typedef struct slotMapIter {
+    slotMap *map;
+    uint16_t next;
+} slotMapIter;
+
+static inline uint16_t slotHandleIdx(const slotHandle handle) {
+    return handle & UINT16_MAX;
+}
+
+static inline uint16_t slotHandleGeneration(const slotHandle handle) {
+    return handle >> 16;
+}
+
+slotMap *createSlotMap(const uint16_t capacity, uint64_t *heapAllocs) {
+    ASSERT(capacity != 0);
+    slotMap *map = fastCalloc(1, sizeof(slotMap));
+    map->dense = fastMalloc(capacity * sizeof(void *));
+    map->denseSlots = fastMalloc(capacity * sizeof(uint16_t));
+    map->slots = fastMalloc(capacity * sizeof(slotMapSlot));
+    map->capacity = capacity;
+    map->freeSlot = UINT16_MAX;
+    map->heapAllocs = heapAllocs;
+    return map;
+}
+
+void destroySlotMap(slotMap *map) {
+    fastFree(map->dense);
+    fastFree(map->denseSlots);
+    fastFree(map->slots);
+    fastFree(map);
+}
+
+static inline uint16_t slotMapSize(const slotMap *map) {
+    return map->size;
+}
+
+// returns the item at a dense index, used for iterating
+static inline void *slotMapGetAt(const slotMap *map, const uint16_t idx) {
+    ASSERTF(idx < map->size, "idx: %d, size: %d", idx, map->size);
+    return map->dense[idx];
+}
+
+static void slotMapGrow(slotMap *map) {
+    if (map->capacity == UINT16_MAX - 1) {
+        ERROR("slot map is full");
+    }
+    const uint16_t capacity = min((uint32_t)map->capacity * 2, (uint32_t)UINT16_MAX - 1);
+    map->dense = fastRealloc(map->dense, capacity * sizeof(void *));
+    map->denseSlots = fastRealloc(map->denseSlots, capacity * sizeof(uint16_t));
+    map->slots = fastRealloc(map->slots, capacity * sizeof(slotMapSlot));
+    map->capacity = capacity;
+    if (map->heapAllocs != NULL) {
+        (*map->heapAllocs)++;
+    }
+}
+
+slotHandle slotMapInsert(slotMap *map, void *item) {
+    uint16_t slotIdx;
+    if (map->freeSlot != UINT16_MAX) {
+        slotIdx = map->freeSlot;
+        map->freeSlot = map->slots[slotIdx].idx;
+    } else {
+        if (map->usedSlots == map->capacity) {
+            slotMapGrow(map);
+        }
+        slotIdx = map->usedSlots++;
+        map->slots[slotIdx].generation = 0;
+    }
+
+    slotMapSlot *slot = &map->slots[slotIdx];
+    slot->idx = map->size;
+    map->dense[map->size] = item;
+    map->denseSlots[map->size] = slotIdx;
+    map->size++;
+
+    return ((uint32_t)slot->generation << 16) | slotIdx;
+}
+
+// returns true if the handle refers to an item that hasn't been removed
+static inline bool slotMapHandleValid(const slotMap *map, const slotHandle handle) {
+    const uint16_t slotIdx = slotHandleIdx(handle);
+    if (slotIdx >= map->usedSlots) {
+        return false;
+    }
+    const slotMapSlot *slot = &map->slots[slotIdx];
+    return slot->generation == slotHandleGeneration(handle) && slot->idx < map->size && map->denseSlots[slot->idx] == slotIdx;
+}
+
+// returns NULL if the item the handle refers to has been removed
+static inline void *slotMapGet(const slotMap *map, const slotHandle handle) {
+    if (!slotMapHandleValid(map, handle)) {
+        return NULL;
+    }
+    return map->dense[map->slots[slotHandleIdx(handle)].idx];
+}
+
+// removes the item at a dense index by moving the last item into its place
+static void slotMapRemoveAt(slotMap *map, const uint16_t idx) {
+    ASSERTF(idx < map->size, "idx: %d, size: %d", idx, map->size);
+    const uint16_t slotIdx = map->denseSlots[idx];
+    const uint16_t last = map->size - 1;
+    if (idx != last) {
+        map->dense[idx] = map->dense[last];
+        map->denseSlots[idx] = map->denseSlots[last];
+        map->slots[map->denseSlots[idx]].idx = idx;
+    }
+    map->size--;
+
+    slotMapSlot *slot = &map->slots[slotIdx];
+    slot->generation++;
+    slot->idx = map->freeSlot;
+    map->freeSlot = slotIdx;
+}
+
+// removes the item the handle refers to; returns false and removes
+// nothing if the handle is stale, as the slot may hold another item
+bool slotMapRemove(slotMap *map, const slotHandle handle) {
+    if (!slotMapHandleValid(map, handle)) {
+        return false;
+    }
+    slotMapRemoveAt(map, map->slots[slotHandleIdx(handle)].idx);
+    return true;
+}
+
+// removes all items, invalidating all of their handles
+void slotMapClear(slotMap *map) {
+    while (map->size != 0) {
+        slotMapRemoveAt(map, map->size - 1);
+    }
+}
+
+static inline void slotMapIterInit(slotMapIter *iter, slotMap *map) {
+    iter->map = map;
+    iter->next = 0;
+}
+
+static inline bool slotMapIterNext(slotMapIter *iter, void **item) {
+    if (iter->next >= iter->map->size) {
+        return false;
+    }
+    *item = iter->map->dense[iter->next++];
+    return true;
+}
+
+// removes the item last returned by slotMapIterNext; the last item is
+// moved into its place and will be returned next
+static inline void slotMapIterRemove(slotMapIter *iter) {
+    ASSERT(iter->next != 0);
+    iter->next--;
+    slotMapRemoveAt(iter->map, iter->next);
+}
+
+#endif
@@ -0,0 +1,522 @@
+#ifndef IMPULSE_WARS_THREAD_POOL_H
+#define IMPULSE_WARS_THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "env.h"
+
+// how many times a worker will check for new work before going to sleep,
+// stepping is usually called in a tight loop so spinning a bit avoids
+// paying for a futex wake up on every batch
+const uint32_t THREAD_POOL_SPIN_ITERS = 1 << 14;
+// envs are split into chunks that workers claim one at a time, idle
+// workers steal chunks from busy ones
+const uint16_t THREAD_POOL_MAX_CHUNK_SIZE = 8;
+const uint16_t THREAD_POOL_CHUNKS_PER_THREAD = 8;
+
+enum poolTask {
+    POOL_TASK_STEP,
+    POOL_TASK_RESET,
+};
+
+// stats about how evenly work was spread across workers, averaged over
+// all batches since the stats were last aggregated
+typedef struct poolStats {
+    float batches;
+    // wall time of a batch in microseconds
+    float batchTime;
+    // busiest worker's time divided by the mean worker time, 1 is perfect
+    float imbalance;
+    float maxImbalance;
+    // time between the first and last worker finishing in microseconds
+    float tailTime;
+    // fraction of total thread time spent not stepping envs
+    float idleFraction;
+    float steals;
+} poolStats;
+
+typedef struct threadPool threadPool;
+
+typedef struct poolWorker {
+    threadPool *pool;
+    pthread_t thread;
+    uint16_t idx;
+    // when every env is stepped each worker starts a batch owning a
+    // contiguous range of chunks of envs [chunkStart, chunkEnd); the head
+    // of the range is packed in the low 32 bits and the tail in the high
+    // 32 bits so the owner popping from the head and thieves stealing
+    // from the tail can both claim chunks with a single CAS
+    uint32_t chunkStart;
+    uint32_t chunkEnd;
+    _Alignas(64) _Atomic uint64_t chunks;
+    // envs stepped by this worker write finished episodes here so logging
+    // doesn't need to be synchronized
+    logBuffer *logs;
+
+    uint64_t startTime;
+    uint64_t endTime;
+    uint32_t steals;
+} poolWorker;
+
+struct threadPool {
+    env *envs;
+    uint16_t numEnvs;
+    uint16_t numThreads;
+    uint16_t chunkSize;
+    uint32_t numChunks;
+    // spinning only helps when every worker has a core to itself, if
+    // there are more threads than cores workers sleep right away
+    uint32_t spinIters;
+    poolWorker *workers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t taskCond;
+    pthread_cond_t doneCond;
+    enum poolTask task;
+    // incremented every time a task is dispatched, workers compare it to
+    // the last generation they ran to know there's new work
+    _Atomic uint64_t generation;
+    _Atomic uint16_t pendingWorkers;
+    _Atomic bool shutdown;
+    // envs the current task runs on, [envStart, envEnd)
+    uint16_t envStart;
+    uint16_t envEnd;
+    // if not NULL, only envs with a non-zero entry are reset
+    const uint8_t *resetMask;
+    // set while a task dispatched by stepEnvsAsync hasn't been waited on
+    bool inFlight;
+    uint64_t batchStart;
+
+    uint64_t statBatches;
+    double batchTimeSum;
+    double imbalanceSum;
+    double maxImbalance;
+    double tailTimeSum;
+    double idleFractionSum;
+    uint64_t stealsSum;
+};
+
+static inline uint64_t packChunks(const uint32_t head, const uint32_t tail) {
+    return ((uint64_t)tail << 32) | head;
+}
+
+// claims a chunk from the head of a worker's deque, returns false if
+// the deque is empty
+static inline bool popChunk(poolWorker *worker, uint32_t *chunk) {
+    uint64_t chunks = atomic_load_explicit(&worker->chunks, memory_order_relaxed);
+    while (true) {
+        const uint32_t head = chunks & UINT32_MAX;
+        const uint32_t tail = chunks >> 32;
+        if (head >= tail) {
+            return false;
+        }
+        if (atomic_compare_exchange_weak_explicit(&worker->chunks, &chunks, packChunks(head + 1, tail), memory_order_acq_rel, memory_order_relaxed)) {
+            *chunk = head;
+            return true;
+        }
+    }
+}
+
+// claims a chunk from the tail of another worker's deque, the chunks
+// the victim would have gotten to last
+static inline bool stealChunk(poolWorker *victim, uint32_t *chunk) {
+    uint64_t chunks = atomic_load_explicit(&victim->chunks, memory_order_relaxed);
+    while (true) {
+        const uint32_t head = chunks & UINT32_MAX;
+        const uint32_t tail = chunks >> 32;
+        if (head >= tail) {
+            return false;
+        }
+        if (atomic_compare_exchange_weak_explicit(&victim->chunks, &chunks, packChunks(head, tail - 1), memory_order_acq_rel, memory_order_relaxed)) {
+            *chunk = tail - 1;
+            return true;
+        }
+    }
+}
+
+static void runPoolChunk(const threadPool *pool, poolWorker *worker, const uint32_t chunk) {
+    // chunks at the edges of the task's envs may only be partly covered
+    const uint16_t envStart = max(chunk * pool->chunkSize, pool->envStart);
+    const uint16_t envEnd = min((chunk + 1) * pool->chunkSize, pool->envEnd);
+    for (uint16_t i = envStart; i < envEnd; i++) {
+        env *e = &pool->envs[i];
+        // envs can be stepped by a different worker every batch
+        e->logs = worker->logs;
+
+        switch (pool->task) {
+        case POOL_TASK_STEP:
+            stepEnv(e);
+            break;
+        case POOL_TASK_RESET:
+            if (pool->resetMask != NULL && pool->resetMask[i] == 0) {
+                republishObs(e);
+                continue;
+            }
+            resetEnv(e);
+            break;
+        default:
+            ERRORF("unknown pool task %d", pool->task);
+        }
+        publishObs(e);
+    }
+}
+
+// steps the worker's own chunks first, then steals chunks from other
+// workers until there are none left anywhere; chunks are only ever
+// claimed during a batch, never pushed, so once every deque has been
+// seen empty the batch is done for this worker
+static void runPoolTask(threadPool *pool, poolWorker *worker) {
+    worker->startTime = nowNs();
+    worker->steals = 0;
+
+    uint32_t chunk;
+    while (popChunk(worker, &chunk)) {
+        runPoolChunk(pool, worker, chunk);
+    }
+
+    for (uint16_t i = 1; i < pool->numThreads; i++) {
+        poolWorker *victim = &pool->workers[(worker->idx + i) % pool->numThreads];
+        while (stealChunk(victim, &chunk)) {
+            runPoolChunk(pool, worker, chunk);
+            worker->steals++;
+        }
+    }
+
+    worker->endTime = nowNs();
+}
+
+static uint64_t waitForPoolTask(threadPool *pool, const uint64_t lastGeneration) {
+    for (uint32_t i = 0; i < pool->spinIters; i++) {
+        const uint64_t generation = atomic_load_explicit(&pool->generation, memory_order_acquire);
+        if (generation != lastGeneration) {
+            return generation;
+        }
+        CPU_RELAX();
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    uint64_t generation = atomic_load_explicit(&pool->generation, memory_order_acquire);
+    while (generation == lastGeneration) {
+        pthread_cond_wait(&pool->taskCond, &pool->lock);
+        generation = atomic_load_explicit(&pool->generation, memory_order_acquire);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return generation;
+}
+
+static void *poolWorkerLoop(void *arg) {
+    poolWorker *worker = arg;
+    threadPool *pool = worker->pool;
+
+    uint64_t generation = 0;
+    while (true) {
+        generation = waitForPoolTask(pool, generation);
+        if (atomic_load_explicit(&pool->shutdown, memory_order_acquire)) {
+            break;
+        }
+
+        runPoolTask(pool, worker);
+
+        // the last worker to finish wakes up the dispatching thread if
+        // it's done spinning and went to sleep
+        if (atomic_fetch_sub_explicit(&pool->pendingWorkers, 1, memory_order_acq_rel) == 1) {
+            pthread_mutex_lock(&pool->lock);
+            pthread_cond_signal(&pool->doneCond);
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+
+    return NULL;
+}
+
+void waitForEnvs(threadPool *pool);
+
+// the calling thread acts as worker 0, so numThreads - 1 threads are
+// spawned; workers stay alive until the pool is destroyed
+threadPool *createThreadPool(env *envs, uint16_t numEnvs, uint16_t numThreads) {
+    if (numThreads == 0) {
+        ERROR("thread pool must have at least 1 thread");
+    }
+    numThreads = min(numThreads, numEnvs);
+
+    threadPool *pool = fastCalloc(1, sizeof(threadPool));
+    pool->envs = envs;
+    pool->numEnvs = numEnvs;
+    pool->numThreads = numThreads;
+    // aim for a few chunks per worker so there's something to steal,
+    // but keep chunks big enough that claiming them is cheap
+    pool->chunkSize = max(1, min(THREAD_POOL_MAX_CHUNK_SIZE, numEnvs / (numThreads * THREAD_POOL_CHUNKS_PER_THREAD)));
+    pool->numChunks = (numEnvs + pool->chunkSize - 1) / pool->chunkSize;
+    pool->spinIters = THREAD_POOL_SPIN_ITERS;
+    if (numThreads > sysconf(_SC_NPROCESSORS_ONLN)) {
+        pool->spinIters = 0;
+    }
+    pool->workers = aligned_alloc(_Alignof(poolWorker), numThreads * sizeof(poolWorker));
+    memset(pool->workers, 0x0, numThreads * sizeof(poolWorker));
+    pool->task = POOL_TASK_STEP;
+    atomic_init(&pool->generation, 0);
+    atomic_init(&pool->pendingWorkers, 0);
+    atomic_init(&pool->shutdown, false);
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->taskCond, NULL);
+    pthread_cond_init(&pool->doneCond, NULL);
+
+    for (uint16_t i = 0; i < numThreads; i++) {
+        poolWorker *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->idx = i;
+        worker->chunkStart = (uint64_t)i * pool->numChunks / numThreads;
+        worker->chunkEnd = (uint64_t)(i + 1) * pool->numChunks / numThreads;
+        atomic_init(&worker->chunks, packChunks(worker->chunkEnd, worker->chunkEnd));
+        worker->logs = createLogBuffer();
+    }
+
+    for (uint16_t i = 1; i < numThreads; i++) {
+        if (pthread_create(&pool->workers[i].thread, NULL, poolWorkerLoop, &pool->workers[i]) != 0) {
+            ERRORF("failed to create thread pool worker %d", i);
+        }
+    }
+
+    return pool;
+}
+
+void destroyThreadPool(threadPool *pool) {
+    waitForEnvs(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    atomic_store_explicit(&pool->shutdown, true, memory_order_release);
+    atomic_fetch_add_explicit(&pool->generation, 1, memory_order_release);
+    pthread_cond_broadcast(&pool->taskCond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (uint16_t i = 1; i < pool->numThreads; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    for (uint16_t i = 0; i < pool->numThreads; i++) {
+        destroyLogBuffer(pool->workers[i].logs);
+    }
+
+    pthread_cond_destroy(&pool->doneCond);
+    pthread_cond_destroy(&pool->taskCond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    fastFree(pool);
+}
+
+// returns the log buffer of the worker that starts out owning the env at
+// envIdx, should be passed to initEnv; envs are pointed at the log buffer
+// of whichever worker steps them each batch
+logBuffer *threadPoolEnvLogs(const threadPool *pool, const uint16_t envIdx) {
+    const uint32_t chunk = envIdx / pool->chunkSize;
+    for (uint16_t i = 0; i < pool->numThreads; i++) {
+        const poolWorker *worker = &pool->workers[i];
+        if (chunk >= worker->chunkStart && chunk < worker->chunkEnd) {
+            return worker->logs;
+        }
+    }
+
+    ERRORF("env %d is not owned by any worker", envIdx);
+}
+
+static void updatePoolStats(threadPool *pool, const uint64_t batchStart, const uint64_t batchEnd) {
+    uint64_t totalBusy = 0;
+    uint64_t maxBusy = 0;
+    uint64_t firstEnd = UINT64_MAX;
+    uint64_t lastEnd = 0;
+    for (uint16_t i = 0; i < pool->numThreads; i++) {
+        const poolWorker *worker = &pool->workers[i];
+        const uint64_t busy = worker->endTime - worker->startTime;
+        totalBusy += busy;
+        maxBusy = max(maxBusy, busy);
+        firstEnd = min(firstEnd, worker->endTime);
+        lastEnd = max(lastEnd, worker->endTime);
+        pool->stealsSum += worker->steals;
+    }
+
+    const double batchTime = max(batchEnd - batchStart, (uint64_t)1);
+    const double meanBusy = max((double)totalBusy / pool->numThreads, 1.0);
+    const double imbalance = maxBusy / meanBusy;
+
+    pool->statBatches++;
+    pool->batchTimeSum += batchTime;
+    pool->imbalanceSum += imbalance;
+    pool->maxImbalance = fmax(pool->maxImbalance, imbalance);
+    pool->tailTimeSum += lastEnd - firstEnd;
+    pool->idleFractionSum += 1.0 - fmin(totalBusy / (batchTime * pool->numThreads), 1.0);
+}
+
+// splits the chunks covering the task's envs evenly between workers
+// [firstWorker, numThreads), other workers start with no chunks
+static void assignPoolChunks(threadPool *pool, const uint16_t firstWorker) {
+    const uint32_t firstChunk = pool->envStart / pool->chunkSize;
+    const uint32_t numChunks = ((pool->envEnd + pool->chunkSize - 1) / pool->chunkSize) - firstChunk;
+    const uint16_t numWorkers = pool->numThreads - firstWorker;
+    for (uint16_t i = 0; i < pool->numThreads; i++) {
+        uint32_t chunkStart = firstChunk;
+        uint32_t chunkEnd = firstChunk;
+        if (i >= firstWorker) {
+            const uint16_t workerIdx = i - firstWorker;
+            chunkStart += (uint64_t)workerIdx * numChunks / numWorkers;
+            chunkEnd += (uint64_t)(workerIdx + 1) * numChunks / numWorkers;
+        }
+        atomic_store_explicit(&pool->workers[i].chunks, packChunks(chunkStart, chunkEnd), memory_order_relaxed);
+    }
+}
+
+// wakes up the spawned workers to run a task on envs [envStart, envEnd)
+// and returns without waiting for them; a task that's still in flight
+// is finished first
+static void dispatchPoolTask(threadPool *pool, const enum poolTask task, const uint16_t envStart, const uint16_t envEnd, const uint16_t firstWorker) {
+    waitForEnvs(pool);
+
+    pool->batchStart = nowNs();
+    pool->task = task;
+    pool->envStart = envStart;
+    pool->envEnd = envEnd;
+    assignPoolChunks(pool, firstWorker);
+    pool->inFlight = true;
+
+    if (pool->numThreads == 1) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    atomic_store_explicit(&pool->pendingWorkers, pool->numThreads - 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pool->generation, 1, memory_order_release);
+    pthread_cond_broadcast(&pool->taskCond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void waitForPoolWorkers(threadPool *pool) {
+    for (uint32_t i = 0; i < pool->spinIters; i++) {
+        if (atomic_load_explicit(&pool->pendingWorkers, memory_order_acquire) == 0) {
+            return;
+        }
+        CPU_RELAX();
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load_explicit(&pool->pendingWorkers, memory_order_acquire) != 0) {
+        pthread_cond_wait(&pool->doneCond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// the calling thread runs as worker 0, stepping its own chunks and
+// stealing any left over, then blocks until all workers are done
+static void finishPoolTask(threadPool *pool) {
+    runPoolTask(pool, &pool->workers[0]);
+    if (pool->numThreads > 1) {
+        waitForPoolWorkers(pool);
+    }
+    updatePoolStats(pool, pool->batchStart, nowNs());
+    pool->inFlight = false;
+}
+
+// runs a task on every env and blocks until all workers are done
+static void runThreadPool(threadPool *pool, const enum poolTask task) {
+    dispatchPoolTask(pool, task, 0, pool->numEnvs, 0);
+    finishPoolTask(pool);
+}
+
+void stepEnvs(threadPool *pool) {
+    runThreadPool(pool, POOL_TASK_STEP);
+}
+
+// resets envs with a non-zero entry in mask, or every env if mask is NULL
+void resetEnvsMasked(threadPool *pool, const uint8_t *mask) {
+    pool->resetMask = mask;
+    runThreadPool(pool, POOL_TASK_RESET);
+    pool->resetMask = NULL;
+}
+
+void resetEnvs(threadPool *pool) {
+    resetEnvsMasked(pool, NULL);
+}
+
+// republishes the observations of envs outside [envStart, envEnd) so
+// every env publishes once per batch and all of their observations stay
+// in the same buffer; envs outside the range are idle so this is done on
+// the calling thread before the batch is dispatched
+static void republishSkippedEnvs(threadPool *pool, const uint16_t envStart, const uint16_t envEnd) {
+    for (uint16_t i = 0; i < envStart; i++) {
+        republishObs(&pool->envs[i]);
+    }
+    for (uint16_t i = envEnd; i < pool->numEnvs; i++) {
+        republishObs(&pool->envs[i]);
+    }
+}
+
+// starts stepping envs [envStart, envEnd) on the spawned workers and
+// returns right away so the caller can do other work, like running
+// inference on the observations of other envs; waitForEnvs must be
+// called before the stepped envs' buffers are read or written. Only one
+// range of envs can be in flight at a time, if one already is it will
+// be finished first. With only 1 thread envs are stepped when waited on.
+// Envs outside the range publish their last observations again.
+void stepEnvsAsync(threadPool *pool, const uint16_t envStart, const uint16_t envEnd) {
+    if (envStart >= envEnd || envEnd > pool->numEnvs) {
+        ERRORF("invalid env range [%d, %d) for %d envs", envStart, envEnd, pool->numEnvs);
+    }
+    // the calling thread is busy elsewhere, so leave its share of chunks
+    // to the spawned workers; it will steal what's left when it waits
+    const uint16_t firstWorker = pool->numThreads > 1 ? 1 : 0;
+    waitForEnvs(pool);
+    republishSkippedEnvs(pool, envStart, envEnd);
+    dispatchPoolTask(pool, POOL_TASK_STEP, envStart, envEnd, firstWorker);
+}
+
+// blocks until envs stepped by stepEnvsAsync are done, helping step
+// them; does nothing if no envs are in flight
+void waitForEnvs(threadPool *pool) {
+    if (pool->inFlight) {
+        finishPoolTask(pool);
+    }
+}
+
+// merges the logs of every worker; worker log buffers don't need to be
+// locked so this is safe to call while the pool is running a task, but
+// only from one thread at a time
+logSummary aggregateAndClearThreadPoolLogs(threadPool *pool, const uint8_t numDrones) {
+    logAggregate *aggregate = fastMalloc(sizeof(logAggregate));
+    initLogAggregate(aggregate);
+    for (uint16_t i = 0; i < pool->numThreads; i++) {
+        drainLogBuffer(pool->workers[i].logs, aggregate);
+    }
+    const logSummary summary = summarizeLogAggregate(aggregate, numDrones);
+    fastFree(aggregate);
+    return summary;
+}
+
+poolStats aggregateAndClearPoolStats(threadPool *pool) {
+    poolStats stats = {0};
+    if (pool->statBatches == 0) {
+        return stats;
+    }
+
+    const double batches = pool->statBatches;
+    stats.batches = batches;
+    stats.batchTime = pool->batchTimeSum / batches / 1000.0;
+    stats.imbalance = pool->imbalanceSum / batches;
+    stats.maxImbalance = pool->maxImbalance;
+    stats.tailTime = pool->tailTimeSum / batches / 1000.0;
+    stats.idleFraction = pool->idleFractionSum / batches;
+    stats.steals = pool->stealsSum / batches;
+
+    pool->statBatches = 0;
+    pool->batchTimeSum = 0.0;
+    pool->imbalanceSum = 0.0;
+    pool->maxImbalance = 0.0;
+    pool->tailTimeSum = 0.0;
+    pool->idleFractionSum = 0.0;
+    pool->stealsSum = 0;
+
+    return stats;
+}
+
+#endif
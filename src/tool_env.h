@@ -0,0 +1,72 @@
+#ifndef IMPULSE_WARS_TOOL_ENV_H
+#define IMPULSE_WARS_TOOL_ENV_H
+
+#include <stdio.h>
+
+#include "env.h"
+
+// setup shared by the standalone tools that drive an env without
+// Python: the benchmarks, the line of sight check and the map path
+// generator
+
+// an env and the buffers it reads and writes
+typedef struct toolEnv {
+    env *e;
+    uint8_t *obs;
+    float *rewards;
+    float *actions;
+    uint8_t *masks;
+    uint8_t *terminals;
+    uint8_t *truncations;
+    logBuffer *logs;
+} toolEnv;
+
+toolEnv createToolEnv(const uint8_t numDrones, const uint8_t numAgents, const int8_t mapIdx, const uint64_t seed, const bool enableTeams, const bool isTraining) {
+    toolEnv t = {0};
+    t.e = fastCalloc(1, sizeof(env));
+
+    posix_memalign((void **)&t.obs, sizeof(void *), alignedSize(numAgents * obsBytes(numDrones), sizeof(float)));
+    t.rewards = fastCalloc(numAgents, sizeof(float));
+    t.actions = fastCalloc(numAgents * CONTINUOUS_ACTION_SIZE, sizeof(float));
+    t.masks = fastCalloc(numAgents, sizeof(uint8_t));
+    t.terminals = fastCalloc(numAgents, sizeof(uint8_t));
+    t.truncations = fastCalloc(numAgents, sizeof(uint8_t));
+    t.logs = createLogBuffer();
+
+    initEnv(t.e, numDrones, numAgents, t.obs, false, t.actions, NULL, t.rewards, t.masks, t.terminals, t.truncations, t.logs, mapIdx, seed, enableTeams, false, isTraining);
+    return t;
+}
+
+void destroyToolEnv(toolEnv *t) {
+    destroyEnv(t->e);
+
+    free(t->obs);
+    fastFree(t->actions);
+    fastFree(t->rewards);
+    fastFree(t->masks);
+    fastFree(t->terminals);
+    fastFree(t->truncations);
+    destroyLogBuffer(t->logs);
+    fastFree(t->e);
+}
+
+// sets up every map, loading precomputed map paths from mapPathsFile if
+// it isn't NULL and computing them if it is or they fail to load
+void initToolMaps(env *e, const char *mapPathsFile) {
+    if (mapPathsFile != NULL && !loadMapPaths(mapPathsFile)) {
+        fprintf(stderr, "failed to load map paths from %s, computing them instead\n", mapPathsFile);
+    }
+    initMaps(e);
+}
+
+void randActions(env *e) {
+    uint16_t actionOffset = 0;
+    for (uint8_t i = 0; i < e->numAgents; i++) {
+        for (uint8_t j = 0; j < CONTINUOUS_ACTION_SIZE; j++) {
+            e->contActions[actionOffset + j] = randFloat(&e->randState, -1.0f, 1.0f);
+        }
+        actionOffset += CONTINUOUS_ACTION_SIZE;
+    }
+}
+
+#endif
@@ -1,6 +1,12 @@
 #ifndef IMPULSE_WARS_TYPES_H
 #define IMPULSE_WARS_TYPES_H
 
+#ifndef AUTOPXD
+#include <stdatomic.h>
+
+#include "log_stats.h"
+#endif
+
 #include "box2d/box2d.h"
 
 // autopxd2 can't parse raylib headers
@@ -16,6 +22,9 @@ typedef struct Vector2 {
 
 #include "include/cc_array.h"
 
+#include "pool.h"
+#include "slot_map.h"
+
 #include "settings.h"
 
 #define _MAX_DRONES 4
@@ -37,6 +46,11 @@ enum entityType {
     DRONE_PIECE_ENTITY,
 };
 
+static inline bool entityTypeIsWall(const enum entityType type) {
+    // walls are the first 3 entity types
+    return type <= DEATH_WALL_ENTITY;
+}
+
 // the category bit that will be set on each entity's shape; this is
 // used to control what entities can collide with each other
 enum shapeCategory {
@@ -69,6 +83,15 @@ enum weaponType {
     MINE_LAUNCHER_WEAPON,
 };
 
+// how continuous observations are stored; they're all scaled to be
+// between -1 and 1, so they can be stored as 16 bit floats or 8 bit ints
+// with little loss of precision
+enum obsFormat {
+    OBS_FORMAT_FLOAT32,
+    OBS_FORMAT_FLOAT16,
+    OBS_FORMAT_INT8,
+};
+
 typedef struct mapBounds {
     b2Vec2 min;
     b2Vec2 max;
@@ -95,9 +118,15 @@ typedef struct mapEntry {
 
     mapBounds bounds;
     mapBounds spawnQuads[4];
+    // number of static walls and merged static walls, set by initMaps
+    uint16_t numWalls;
+    uint16_t numMergedWalls;
     bool *droneSpawns;
     uint8_t *packedLayout;
     nearEntity *nearestWalls;
+    // direction to move in to get from one cell to another, indexed by
+    // mapPathOffset; 8 or more means there is no path
+    uint8_t *paths;
 } mapEntry;
 
 // a cell in the map; ent will be NULL if the cell is empty
@@ -117,6 +146,16 @@ typedef struct wallEntity {
     bool isFloating;
     enum entityType type;
     bool isSuddenDeath;
+    // only set for floating walls
+    slotHandle handle;
+    // static map walls of the same type are merged into boxes covering
+    // as many cells as possible to keep the broadphase small; the wall
+    // of each cell has no body of its own and points to the merged wall
+    // that owns the body and shape covering it
+    struct wallEntity *merged;
+    // number of cells covered by a merged wall, 0 for all other walls
+    uint8_t mergedColumns;
+    uint8_t mergedRows;
 
     entity *ent;
 } wallEntity;
@@ -163,6 +202,7 @@ typedef struct weaponPickupEntity {
     int16_t mapCellIdx;
 
     entity *ent;
+    slotHandle handle;
     bool bodyDestroyed;
 } weaponPickupEntity;
 
@@ -181,14 +221,14 @@ typedef struct projectileEntity {
     // used for proximity explosive projectiles
     b2ShapeId sensorID;
     weaponInformation *weaponInfo;
+    // the last and current position and distance traveled are stored
+    // in env.projectileCols so they can be updated in bulk
     b2Vec2 pos;
     int16_t mapCellIdx;
-    b2Vec2 lastPos;
     b2Vec2 velocity;
     b2Vec2 lastVelocity;
     float speed;
     float lastSpeed;
-    float distance;
     uint8_t bounces;
     uint8_t contacts;
     bool setMine;
@@ -197,11 +237,43 @@ typedef struct projectileEntity {
     bool needsToBeDestroyed;
 
     entity *ent;
+    slotHandle handle;
 
-    // for rendering
-    trailPoints trailPoints;
+    // for rendering, only allocated if the env is being rendered
+    trailPoints *trailPoints;
 } projectileEntity;
 
+// hot projectile fields stored as a struct of arrays indexed by the slot
+// index of each projectile's handle; slot indexes are stable for the
+// lifetime of a projectile so nothing has to move when one is removed
+typedef struct projectileColumns {
+    float *posX;
+    float *posY;
+    float *lastPosX;
+    float *lastPosY;
+    float *distance;
+    // set to INFINITY for projectiles without a max distance
+    float *maxDistance;
+    // set every step if a projectile traveled past its max distance
+    uint8_t *expired;
+    uint16_t capacity;
+} projectileColumns;
+
+// a box2d body and shapes of a projectile; bodies are disabled instead
+// of destroyed when a projectile is destroyed so they can be reused
+typedef struct projectileBody {
+    b2BodyId bodyID;
+    b2ShapeId shapeID;
+    b2ShapeId sensorID;
+    enum weaponType weapon;
+} projectileBody;
+
+typedef struct projectileBodyList {
+    projectileBody *bodies;
+    uint16_t size;
+    uint16_t capacity;
+} projectileBodyList;
+
 // used to keep track of what happened each step for reward purposes
 typedef struct droneStepInfo {
     bool firedShot;
@@ -238,6 +310,7 @@ typedef struct dronePieceEntity {
     bool isShieldPiece;
 
     entity *ent;
+    slotHandle handle;
 
     uint16_t lifetime;
 } dronePieceEntity;
@@ -303,17 +376,106 @@ typedef struct droneStats {
     float wins;
 } droneStats;
 
+// average microseconds spent per env step in each phase of stepping,
+// only measured when built with STEP_TIMERS defined
+typedef struct stepTimings {
+    float actions;
+    float physics;
+    float bodyMoveEvents;
+    float contactEvents;
+    float sensorEvents;
+    float projectiles;
+    float drones;
+    float pickups;
+    float rewards;
+    float obs;
+    float reset;
+} stepTimings;
+
+// box2d's profile timings in milliseconds and world counters averaged
+// per physics step, only recorded when built with PHYSICS_STATS defined
+typedef struct physicsStats {
+    float step;
+    // broadphase
+    float pairs;
+    float refit;
+    // narrowphase
+    float collide;
+    float solve;
+    float solveConstraints;
+    // continuous collision of bullets
+    float continuous;
+    float splitIslands;
+    float sleepIslands;
+
+    float bodies;
+    float shapes;
+    float contacts;
+    float joints;
+    float islands;
+    float treeHeight;
+    float staticTreeHeight;
+} physicsStats;
+
 typedef struct logEntry {
     float length;
     float ties;
+    // heap allocations the env made while stepping during the episode,
+    // should be 0 once the env has warmed up; box2d's internal
+    // allocations aren't counted
+    float heapAllocs;
+    stepTimings stepTimes;
+    physicsStats physics;
     droneStats stats[_MAX_DRONES];
 } logEntry;
 
+// the distribution of a stat over logged episodes
+typedef struct logDistribution {
+    float min;
+    float max;
+    float p10;
+    float p50;
+    float p90;
+    float p99;
+} logDistribution;
+
+// stats of every episode logged since the last time logs were aggregated
+typedef struct logSummary {
+    float episodes;
+    logEntry mean;
+    logEntry stddev;
+    logDistribution length;
+    logDistribution reward[_MAX_DRONES];
+} logSummary;
+
+// autopxd2 can't parse atomics, Cython only needs a pointer anyway
+#ifndef AUTOPXD
+// every field of a log entry is a float so running stats can be kept
+// for each field by treating a log entry as an array
+#define NUM_LOG_FIELDS (sizeof(logEntry) / sizeof(float))
+
+// running stats of logged episodes, memory used is constant no matter
+// how many episodes are logged
+typedef struct logAggregate {
+    uint32_t count;
+    runningStat fields[NUM_LOG_FIELDS];
+    quantileSketch length;
+    quantileSketch reward[_MAX_DRONES];
+} logAggregate;
+
+// the thread stepping envs adds episodes to the active aggregate while
+// the thread collecting logs swaps which aggregate is active and reads
+// the inactive one, so neither has to take a lock
 typedef struct logBuffer {
-    logEntry *logs;
-    uint16_t size;
-    uint16_t capacity;
+    logAggregate aggregates[2];
+    _Atomic uint8_t active;
+    // the aggregate the stepping thread is currently updating, or
+    // LOG_AGGREGATE_NONE if it isn't updating one
+    _Atomic uint8_t writing;
 } logBuffer;
+#else
+typedef struct logBuffer logBuffer;
+#endif
 
 typedef struct rayClient {
     float scale;
@@ -355,10 +517,18 @@ typedef struct agentActions {
     bool discardWeapon;
 } agentActions;
 
-typedef struct pathingInfo {
-    uint8_t *paths;
-    int8_t *pathBuffer;
-} pathingInfo;
+// entity data every agent's observations are computed from, computed
+// once per step instead of once per agent
+typedef struct obsEntityCache {
+    // packed map layout of the current map with weapon pickups and
+    // floating walls added, one byte for each cell
+    uint8_t *mapLayout;
+    // transforms of floating walls, indexed the same as the floating
+    // walls slot map
+    b2Transform *floatingWallTransforms;
+    b2Vec2 droneAccels[_MAX_DRONES];
+    float droneAimAngles[_MAX_DRONES];
+} obsEntityCache;
 
 typedef struct env {
     uint8_t numDrones;
@@ -368,10 +538,17 @@ typedef struct env {
     bool sittingDuck;
     bool isTraining;
 
+    enum obsFormat obsFormat;
     uint16_t obsBytes;
     uint16_t discreteObsBytes;
 
+    // observations are computed into obs; if they're double buffered
+    // publishedObs holds the last published observations, and
+    // publishedObsIdx is 0 if it's the buffer passed to initEnv or 1 if
+    // it's the back buffer
     uint8_t *obs;
+    uint8_t *publishedObs;
+    uint8_t publishedObsIdx;
     float *rewards;
     bool discretizeActions;
     float *contActions;
@@ -379,6 +556,7 @@ typedef struct env {
     uint8_t *masks;
     uint8_t *terminals;
     uint8_t *truncations;
+    obsEntityCache obsCache;
 
     uint8_t frameRate;
     float deltaTime;
@@ -393,21 +571,65 @@ typedef struct env {
 
     b2WorldId worldID;
     int8_t pinnedMapIdx;
+    // if not -1 every map uses this weapon as the default weapon
+    int8_t pinnedDefaultWeapon;
     int8_t mapIdx;
     mapEntry *map;
     int8_t lastSpawnQuad;
     uint8_t spawnedWeaponPickups[_NUM_WEAPONS];
     weaponInformation *defaultWeapon;
-    CC_Array *cells;
+    // flat grid of the current map's cells, sized for the largest map
+    // so it's never reallocated when switching maps
+    mapCell *cells;
+    uint16_t numCells;
+    // static walls of the current map
     CC_Array *walls;
-    CC_Array *floatingWalls;
+    // static walls of every map that has been set up, indexed by map
+    CC_Array **mapWalls;
+    // merged static walls of the current map and of every map that has
+    // been set up; these own the bodies of the static walls
+    CC_Array *mergedWalls;
+    CC_Array **mapMergedWalls;
+    slotMap *floatingWalls;
     CC_Array *drones;
-    CC_Array *pickups;
-    CC_Array *projectiles;
+    slotMap *pickups;
+    slotMap *projectiles;
+    projectileColumns projectileCols;
+    // disabled projectile bodies ready to be reused for each weapon
+    projectileBodyList freeProjectileBodies[_NUM_WEAPONS];
+    // bodies of projectiles destroyed this step and last step; box2d may
+    // still report events for their shapes so they aren't reused until
+    // those events have been handled
+    projectileBodyList releasedProjectileBodies;
+    projectileBodyList coolingProjectileBodies;
     CC_Array *explodingProjectiles;
-    CC_Array *dronePieces;
-
-    pathingInfo *mapPathing;
+    slotMap *dronePieces;
+
+    // entities are allocated from per-env pools so stepping doesn't
+    // allocate once the pools have grown large enough
+    objectPool entityPool;
+    objectPool wallPool;
+    objectPool pickupPool;
+    objectPool dronePool;
+    objectPool shieldPool;
+    objectPool projectilePool;
+    objectPool projectileTrailPool;
+    objectPool dronePiecePool;
+    objectPool explosionPool;
+    objectPool trailPointPool;
+    // heap allocations made by the pools, slot maps, projectile columns
+    // and arrays that grow while stepping since the env was created, and
+    // the count when the current episode started
+    uint64_t heapAllocs;
+    uint64_t episodeStartHeapAllocs;
+    // total microseconds spent in each phase of stepping and the number
+    // of steps measured since the last episode was logged
+    stepTimings stepTimes;
+    uint32_t timedSteps;
+    // box2d stats summed over every physics step since the last episode
+    // was logged
+    physicsStats physicsTotals;
+    uint32_t physicsSteps;
 
     uint16_t totalSteps;
     uint16_t totalSuddenDeathSteps;
@@ -0,0 +1,160 @@
+#include "thread_pool.h"
+#include "vec_env.h"
+
+_Static_assert(VEC_ENV_MAX_DRONES == _MAX_DRONES, "VEC_ENV_MAX_DRONES must match _MAX_DRONES");
+_Static_assert(VEC_ENV_OBS_FLOAT32 == OBS_FORMAT_FLOAT32, "VEC_ENV_OBS_FLOAT32 must match OBS_FORMAT_FLOAT32");
+_Static_assert(VEC_ENV_OBS_FLOAT16 == OBS_FORMAT_FLOAT16, "VEC_ENV_OBS_FLOAT16 must match OBS_FORMAT_FLOAT16");
+_Static_assert(VEC_ENV_OBS_INT8 == OBS_FORMAT_INT8, "VEC_ENV_OBS_INT8 must match OBS_FORMAT_INT8");
+
+struct vecEnv {
+    vecEnvConfig config;
+    env *envs;
+    threadPool *pool;
+    vecEnvBuffers buffers;
+};
+
+// maps are shared by every env in the process, so they're only set up
+// by the first vec env created and destroyed with the last one
+static uint16_t numLiveVecEnvs = 0;
+
+vecEnv *vecEnvCreate(const vecEnvConfig *config) {
+    if (config->numEnvs == 0) {
+        ERROR("vec env must have at least 1 env");
+    }
+    if (config->numDrones == 0 || config->numDrones > _MAX_DRONES) {
+        ERRORF("number of drones must be between 1 and %d, got %d", _MAX_DRONES, config->numDrones);
+    }
+    if (config->numAgents == 0 || config->numAgents > config->numDrones) {
+        ERRORF("number of agents must be between 1 and the number of drones, got %d", config->numAgents);
+    }
+    if (config->enableTeams && (config->numDrones % 2 != 0 || config->numDrones <= 2)) {
+        ERROR("teams are only supported for even numbers of drones greater than 2");
+    }
+    if (config->obsFormat > OBS_FORMAT_INT8) {
+        ERRORF("unknown obs format %d", config->obsFormat);
+    }
+
+    vecEnv *ve = fastCalloc(1, sizeof(vecEnv));
+    ve->config = *config;
+    // the path is only used while creating
+    ve->config.mapPathsFile = NULL;
+
+    const uint32_t numAgents = (uint32_t)config->numEnvs * config->numAgents;
+    vecEnvBuffers *buf = &ve->buffers;
+    buf->numAgents = numAgents;
+    buf->obsBytes = formattedObsBytes(config->numDrones, config->obsFormat);
+    buf->continuousObsOffset = alignedSize(discreteObsSize(config->numDrones) * sizeof(uint8_t), sizeof(float));
+    buf->continuousObsSize = continuousObsSize(config->numDrones);
+    buf->continuousObsValueBytes = obsFormatValueBytes(config->obsFormat);
+    buf->contActionSize = CONTINUOUS_ACTION_SIZE;
+    buf->discActionSize = DISCRETE_ACTION_SIZE;
+    // continuous observations are read as floats, keep rows aligned
+    if (posix_memalign((void **)&buf->obs, 64, alignedSize(numAgents * buf->obsBytes, 64)) != 0) {
+        ERROR("failed to allocate vec env observations");
+    }
+    memset(buf->obs, 0x0, numAgents * buf->obsBytes);
+    buf->contActions = fastCalloc(numAgents * CONTINUOUS_ACTION_SIZE, sizeof(float));
+    buf->discActions = fastCalloc(numAgents * DISCRETE_ACTION_SIZE, sizeof(int32_t));
+    buf->rewards = fastCalloc(numAgents, sizeof(float));
+    buf->masks = fastCalloc(numAgents, sizeof(uint8_t));
+    buf->terminals = fastCalloc(numAgents, sizeof(uint8_t));
+    buf->truncations = fastCalloc(numAgents, sizeof(uint8_t));
+
+    ve->envs = fastCalloc(config->numEnvs, sizeof(env));
+    ve->pool = createThreadPool(ve->envs, config->numEnvs, config->numThreads);
+
+    for (uint16_t i = 0; i < config->numEnvs; i++) {
+        const uint32_t agentOffset = (uint32_t)i * config->numAgents;
+        int8_t mapIdx = -1;
+        if (config->isTraining) {
+            mapIdx = i % NUM_MAPS;
+        }
+
+        initEnv(
+            &ve->envs[i],
+            config->numDrones,
+            config->numAgents,
+            buf->obs + (agentOffset * buf->obsBytes),
+            config->discretizeActions,
+            buf->contActions + (agentOffset * CONTINUOUS_ACTION_SIZE),
+            buf->discActions + (agentOffset * DISCRETE_ACTION_SIZE),
+            buf->rewards + agentOffset,
+            buf->masks + agentOffset,
+            buf->terminals + agentOffset,
+            buf->truncations + agentOffset,
+            threadPoolEnvLogs(ve->pool, i),
+            mapIdx,
+            config->seed + i,
+            config->enableTeams,
+            config->sittingDuck,
+            config->isTraining
+        );
+        setObsFormat(&ve->envs[i], config->obsFormat);
+    }
+
+    if (numLiveVecEnvs == 0) {
+        if (config->mapPathsFile != NULL && !loadMapPaths(config->mapPathsFile)) {
+            fprintf(stderr, "failed to load map paths from %s, computing them instead\n", config->mapPathsFile);
+        }
+        initMaps(&ve->envs[0]);
+    }
+    numLiveVecEnvs++;
+
+    for (uint16_t i = 0; i < config->numEnvs; i++) {
+        setupEnv(&ve->envs[i]);
+    }
+
+    return ve;
+}
+
+vecEnvBuffers vecEnvGetBuffers(const vecEnv *ve) {
+    return ve->buffers;
+}
+
+void vecEnvStep(vecEnv *ve) {
+    stepEnvs(ve->pool);
+}
+
+void vecEnvReset(vecEnv *ve, const uint8_t *mask) {
+    resetEnvsMasked(ve->pool, mask);
+}
+
+vecEnvLog vecEnvAggregateLogs(vecEnv *ve) {
+    const logSummary summary = aggregateAndClearThreadPoolLogs(ve->pool, ve->config.numDrones);
+
+    vecEnvLog log = {0};
+    log.episodes = summary.episodes;
+    log.length = summary.mean.length;
+    log.lengthStddev = summary.stddev.length;
+    log.lengthP50 = summary.length.p50;
+    log.lengthP99 = summary.length.p99;
+    log.ties = summary.mean.ties;
+    for (uint8_t i = 0; i < ve->config.numDrones; i++) {
+        log.reward[i] = summary.mean.stats[i].reward;
+        log.rewardStddev[i] = summary.stddev.stats[i].reward;
+        log.wins[i] = summary.mean.stats[i].wins;
+    }
+    return log;
+}
+
+void vecEnvDestroy(vecEnv *ve) {
+    destroyThreadPool(ve->pool);
+    for (uint16_t i = 0; i < ve->config.numEnvs; i++) {
+        destroyEnv(&ve->envs[i]);
+    }
+    numLiveVecEnvs--;
+    if (numLiveVecEnvs == 0) {
+        destroyMaps();
+    }
+
+    vecEnvBuffers *buf = &ve->buffers;
+    free(buf->obs);
+    fastFree(buf->contActions);
+    fastFree(buf->discActions);
+    fastFree(buf->rewards);
+    fastFree(buf->masks);
+    fastFree(buf->terminals);
+    fastFree(buf->truncations);
+    fastFree(ve->envs);
+    fastFree(ve);
+}
@@ -0,0 +1,98 @@
+#ifndef IMPULSE_WARS_VEC_ENV_H
+#define IMPULSE_WARS_VEC_ENV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// a C API for stepping a batch of envs without going through Python;
+// this header only declares the API so it can be used with the shared
+// library without any of the env's headers or dependencies
+
+#define VEC_ENV_API __attribute__((visibility("default")))
+
+// must match the max number of drones the library was built with
+#define VEC_ENV_MAX_DRONES 4
+
+// how continuous observations are stored, int8 observations are
+// round(value * 127)
+#define VEC_ENV_OBS_FLOAT32 0
+#define VEC_ENV_OBS_FLOAT16 1
+#define VEC_ENV_OBS_INT8 2
+
+typedef struct vecEnv vecEnv;
+
+typedef struct vecEnvConfig {
+    uint16_t numEnvs;
+    uint8_t numDrones;
+    // drones that aren't controlled by agents are scripted
+    uint8_t numAgents;
+    bool discretizeActions;
+    bool enableTeams;
+    // scripted drones will do nothing
+    bool sittingDuck;
+    bool isTraining;
+    // one of VEC_ENV_OBS_*
+    uint8_t obsFormat;
+    uint64_t seed;
+    // the calling thread is used as a worker, so 1 thread steps envs
+    // without spawning any threads
+    uint16_t numThreads;
+    // precomputed map paths created by gen_map_paths, paths are computed
+    // when creating the first vec env if this is NULL or the file can't
+    // be used
+    const char *mapPathsFile;
+} vecEnvConfig;
+
+// buffers shared with the envs, owned by the vec env; every buffer holds
+// a row for each agent of each env, envs are laid out contiguously so
+// the agents of env i start at row i * numAgents of the config
+typedef struct vecEnvBuffers {
+    uint32_t numAgents;
+    // size of an agent's observation in bytes; observations start with
+    // bit packed discrete observations, followed by continuous
+    // observations at continuousObsOffset in the configured obs format
+    uint16_t obsBytes;
+    uint16_t continuousObsOffset;
+    uint16_t continuousObsSize;
+    uint8_t continuousObsValueBytes;
+    uint8_t *obs;
+    // only one of contActions and discActions is read depending on
+    // discretizeActions
+    uint8_t contActionSize;
+    uint8_t discActionSize;
+    float *contActions;
+    int32_t *discActions;
+    float *rewards;
+    uint8_t *masks;
+    uint8_t *terminals;
+    uint8_t *truncations;
+} vecEnvBuffers;
+
+// stats of episodes finished since logs were last aggregated
+typedef struct vecEnvLog {
+    float episodes;
+    float length;
+    float lengthStddev;
+    float lengthP50;
+    float lengthP99;
+    float ties;
+    float reward[VEC_ENV_MAX_DRONES];
+    float rewardStddev[VEC_ENV_MAX_DRONES];
+    float wins[VEC_ENV_MAX_DRONES];
+} vecEnvLog;
+
+// creates and sets up every env, observations are ready to be read once
+// this returns; exits if the config is invalid
+VEC_ENV_API vecEnv *vecEnvCreate(const vecEnvConfig *config);
+VEC_ENV_API vecEnvBuffers vecEnvGetBuffers(const vecEnv *ve);
+// steps every env with the actions in the action buffers; envs are
+// automatically reset the step after an episode ends
+VEC_ENV_API void vecEnvStep(vecEnv *ve);
+// resets envs whose entry in mask is non-zero, or every env if mask is
+// NULL; mask must have an entry for every env
+VEC_ENV_API void vecEnvReset(vecEnv *ve, const uint8_t *mask);
+// can be called at any time, but only from one thread at a time
+VEC_ENV_API vecEnvLog vecEnvAggregateLogs(vecEnv *ve);
+VEC_ENV_API void vecEnvDestroy(vecEnv *ve);
+
+#endif
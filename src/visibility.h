@@ -0,0 +1,146 @@
+#ifndef IMPULSE_WARS_VISIBILITY_H
+#define IMPULSE_WARS_VISIBILITY_H
+
+#include <math.h>
+
+#include "helpers.h"
+#include "settings.h"
+#include "types.h"
+
+// line of sight checks that don't need box2d; static walls always fill
+// whole cells of the map grid, so whether a segment passes through a
+// static wall can be answered by walking the cells the segment crosses
+
+// returns the entity box2d reports for a wall's shape; walls of cells
+// covered by a merged wall share the merged wall's body and shape
+static inline const entity *wallShapeOwner(const entity *ent) {
+    if (ent == NULL || !entityTypeIsWall(ent->type)) {
+        return ent;
+    }
+    const wallEntity *wall = ent->entity;
+    if (wall->merged != NULL) {
+        return wall->merged->ent;
+    }
+    return ent;
+}
+
+// returns the static wall whose shape covers the cell at col and row,
+// or NULL if there isn't one
+static inline const entity *cellWall(const env *e, const int16_t col, const int16_t row) {
+    if (col < 0 || row < 0 || col >= e->map->columns || row >= e->map->rows) {
+        return NULL;
+    }
+    const entity *ent = e->cells[col + (row * e->map->columns)].ent;
+    if (ent == NULL || !entityTypeIsWall(ent->type)) {
+        return NULL;
+    }
+    return wallShapeOwner(ent);
+}
+
+// returns true if the segment from startPos to endPos passes through a
+// static wall; walls of target type are ignored and so is the wall the
+// segment starts in, as box2d ignores shapes that contain the start of
+// a ray
+bool segmentHitsStaticWall(const env *e, const b2Vec2 startPos, const b2Vec2 endPos, const entity *srcEnt, const enum entityType *targetType) {
+    // positions in cell units from the top left corner of the map
+    const float originX = -((float)e->map->columns * WALL_THICKNESS) / 2.0f;
+    const float originY = -((float)e->map->rows * WALL_THICKNESS) / 2.0f;
+    const float startX = (startPos.x - originX) / WALL_THICKNESS;
+    const float startY = (startPos.y - originY) / WALL_THICKNESS;
+    const float endX = (endPos.x - originX) / WALL_THICKNESS;
+    const float endY = (endPos.y - originY) / WALL_THICKNESS;
+
+    int16_t col = floorf(startX);
+    int16_t row = floorf(startY);
+    const int16_t endCol = floorf(endX);
+    const int16_t endRow = floorf(endY);
+    // merged walls span multiple cells, so every cell of the merged wall
+    // the segment starts in has to be ignored
+    const entity *startWall = cellWall(e, col, row);
+    const entity *srcWall = wallShapeOwner(srcEnt);
+
+    // the fraction of the segment needed to cross a whole cell on each
+    // axis, and to cross the next cell boundary on each axis
+    const float dx = endX - startX;
+    const float dy = endY - startY;
+    int8_t stepX = 0;
+    float deltaX = INFINITY;
+    float nextX = INFINITY;
+    if (dx > 0.0f) {
+        stepX = 1;
+        deltaX = 1.0f / dx;
+        nextX = ((float)(col + 1) - startX) * deltaX;
+    } else if (dx < 0.0f) {
+        stepX = -1;
+        deltaX = -1.0f / dx;
+        nextX = (startX - (float)col) * deltaX;
+    }
+    int8_t stepY = 0;
+    float deltaY = INFINITY;
+    float nextY = INFINITY;
+    if (dy > 0.0f) {
+        stepY = 1;
+        deltaY = 1.0f / dy;
+        nextY = ((float)(row + 1) - startY) * deltaY;
+    } else if (dy < 0.0f) {
+        stepY = -1;
+        deltaY = -1.0f / dy;
+        nextY = (startY - (float)row) * deltaY;
+    }
+
+    while (col != endCol || row != endRow) {
+        if (nextX < nextY) {
+            if (nextX > 1.0f) {
+                break;
+            }
+            col += stepX;
+            nextX += deltaX;
+        } else {
+            if (nextY > 1.0f) {
+                break;
+            }
+            row += stepY;
+            nextY += deltaY;
+        }
+
+        const entity *wall = cellWall(e, col, row);
+        if (wall == NULL || wall == startWall || wall == srcWall) {
+            continue;
+        }
+        if (targetType == NULL || wall->type != *targetType) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// returns true if any floating wall other than srcEnt could touch the
+// segment from startPos to endPos
+bool floatingWallNearSegment(const env *e, const b2Vec2 startPos, const b2Vec2 endPos, const entity *srcEnt, const enum entityType *targetType) {
+    const b2Vec2 segment = b2Sub(endPos, startPos);
+    const float lengthSquared = b2LengthSquared(segment);
+
+    for (uint16_t i = 0; i < slotMapSize(e->floatingWalls); i++) {
+        const wallEntity *wall = slotMapGetAt(e->floatingWalls, i);
+        if (wall->ent == srcEnt || (targetType != NULL && wall->type == *targetType)) {
+            continue;
+        }
+
+        // distance from the wall's center to the closest point on the
+        // segment compared to the radius of the wall's bounding circle
+        float t = 0.0f;
+        if (lengthSquared != 0.0f) {
+            t = clamp(b2Dot(b2Sub(wall->pos, startPos), segment) / lengthSquared);
+        }
+        const b2Vec2 closest = b2MulAdd(startPos, t, segment);
+        const float radius = b2Length(wall->extent);
+        if (b2DistanceSquared(closest, wall->pos) <= radius * radius) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif